@@ -6,28 +6,217 @@
 #include <algorithm>
 #include <fstream>
 #include <chrono>
+#include <thread>
+#include <filesystem>
 #include <glm/gtc/matrix_transform.hpp>
+#include "vertexquantizer.h"
+#include "meshprocessing.h"
+#include "atomicfile.h"
 
-AppVulkanCore::AppVulkanCore(int height, int width)
+AppVulkanCore::AppVulkanCore(int height, int width, AppSettings settings)
 {
     this->height = height;
     this->width = width;
+    this->settings = settings;
+    if(this->settings.gpuCulling){
+        this->settings.instanced = true;
+    }
+    framesInFlight = std::clamp<uint32_t>(settings.framesInFlight, 1, MAX_FRAMES_IN_FLIGHT_LIMIT);
+    uint32_t threadCount = settings.workerThreads > 0 ? settings.workerThreads : std::max(1u, std::thread::hardware_concurrency());
+    threadCount = std::min(threadCount, MAX_JOB_THREADS);
+    jobs.init(threadCount - 1, settings.pinThreads);
+    recordThreadCount = threadCount;
+    profiler.setEnabled(settings.profile || !settings.tracePath.empty() || settings.benchmarkFrames > 0);
 #ifdef NDEBUG
     validationLayers.push_back("VK_LAYER_KHRONOS_validation");
 #endif
     physicalDevice = VK_NULL_HANDLE;
-    deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    if(!settings.headless){
+        deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+
+    buildSyntheticScene();
+}
+
+void AppVulkanCore::buildSyntheticScene()
+{
+    if(!settings.meshPath.empty()){
+        meshFile.open(settings.meshPath);
+        mesh = loadMeshFile(meshFile, settings.meshPath);
+        std::cout << "Mesh: " << settings.meshPath << ", " << mesh.vertexCount << " " << vertexFormatName(mesh.vertexFormat)
+                  << " vertices, " << mesh.indexCount / 3 << " triangles, " << (mesh.indexType == VK_INDEX_TYPE_UINT32 ? 32 : 16)
+                  << "-bit indices" << std::endl;
+    } else{
+        buildGridMesh();
+    }
+    if(settings.optimizeMesh){
+        optimizeSceneMesh();
+    }
+    if(!settings.saveMeshPath.empty()){
+        writeMeshFile(settings.saveMeshPath, mesh);
+        std::cout << "Mesh: written to " << settings.saveMeshPath << std::endl;
+    }
+
+    uint32_t objectCount = std::max<uint32_t>(settings.objectCount, 1);
+    uint32_t side = 1;
+    while(side * side < objectCount){
+        side++;
+    }
+    float spacing = 2.0f / side;
+    objectTransforms.clear();
+    for(uint32_t i = 0; i < objectCount; i++){
+        if(objectCount == 1){
+            objectTransforms.push_back(glm::mat4(1.0f));
+            break;
+        }
+        glm::vec3 position(-1.0f + spacing * (i % side + 0.5f), -1.0f + spacing * (i / side + 0.5f), 0.0f);
+        glm::mat4 transform = glm::translate(glm::mat4(1.0f), position);
+        objectTransforms.push_back(glm::scale(transform, glm::vec3(spacing * 0.8f)));
+    }
+
+    // Instancing moves the per-object transforms into the instance stream and leaves one shared uniform block
+    instances.clear();
+    if(settings.instanced){
+        instances.resize(objectTransforms.size());
+        for(size_t i = 0; i < objectTransforms.size(); i++){
+            float u = static_cast<float>(i % side) / side;
+            float v = static_cast<float>(i / side) / side;
+            instances[i].transform = objectTransforms[i];
+            instances[i].color = glm::vec4(0.5f + 0.5f * u, 0.5f + 0.5f * v, 1.0f, 1.0f);
+        }
+        objectTransforms.assign(1, glm::mat4(1.0f));
+    }
+
+    instanceBounds.clear();
+    if(settings.gpuCulling){
+        glm::vec3 center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+        float radius = glm::length(mesh.boundsMax - center);
+
+        instanceBounds.resize(instances.size());
+        for(size_t i = 0; i < instances.size(); i++){
+            const glm::mat4& transform = instances[i].transform;
+            float scale = std::max({glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))});
+            instanceBounds[i] = glm::vec4(glm::vec3(transform * glm::vec4(center, 1.0f)), radius * scale);
+        }
+    }
+
+    // Compact positions are relative to the mesh bounds, the dequantization is folded into
+    // whichever transform is applied to the vertex first so the shaders stay the same
+    if(mesh.vertexFormat != VertexFormat::Float){
+        glm::mat4 dequantize = mesh.quantization.dequantizeMatrix();
+        for(InstanceData& instance : instances){
+            instance.transform = instance.transform * dequantize;
+        }
+        if(instances.empty()){
+            for(glm::mat4& transform : objectTransforms){
+                transform = transform * dequantize;
+            }
+        }
+    }
+    objectUniformOffsets.resize(objectTransforms.size());
+}
+
+void AppVulkanCore::buildGridMesh()
+{
+    // Corner colors of the original quad, interpolated across the subdivided grid
+    glm::vec3 corners[] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {1, 1, 1}};
+
+    // Keeps the index count of the largest grid within 32 bits
+    uint32_t cells = 1;
+    while(2ull * cells * cells < settings.trianglesPerObject && cells < 16384){
+        cells++;
+    }
+    uint32_t vertexCount = (cells + 1) * (cells + 1);
+    bool wideIndices = vertexCount > 65536;
+
+    // Rows are independent, so large grids are generated on the job threads
+    vertices.resize(vertexCount);
+    indices16.clear();
+    indices32.clear();
+    if(wideIndices){
+        indices32.resize(size_t(cells) * cells * 6);
+    } else{
+        indices16.resize(size_t(cells) * cells * 6);
+    }
+    jobs.parallelFor(cells + 1, 16, [&](uint32_t begin, uint32_t end){
+        for(uint32_t y = begin; y < end; y++){
+            for(uint32_t x = 0; x <= cells; x++){
+                float u = static_cast<float>(x) / cells;
+                float v = static_cast<float>(y) / cells;
+                glm::vec3 color = (corners[0] * (1 - u) + corners[1] * u) * (1 - v) + (corners[3] * (1 - u) + corners[2] * u) * v;
+                vertices[y * (cells + 1) + x] = Vertex({u - 0.5f, v - 0.5f, 0}, color);
+            }
+            if(y == cells) continue;
+            for(uint32_t x = 0; x < cells; x++){
+                uint32_t i0 = y * (cells + 1) + x;
+                uint32_t i1 = i0 + 1;
+                uint32_t i2 = i1 + cells + 1;
+                uint32_t i3 = i0 + cells + 1;
+                uint32_t quad[] = {i0, i1, i3, i1, i2, i3};
+                size_t first = (size_t(y) * cells + x) * 6;
+                for(uint32_t corner = 0; corner < 6; corner++){
+                    if(wideIndices){
+                        indices32[first + corner] = quad[corner];
+                    } else{
+                        indices16[first + corner] = static_cast<uint16_t>(quad[corner]);
+                    }
+                }
+            }
+        }
+    });
+
+    mesh = Mesh{};
+    mesh.vertexFormat = settings.vertexFormat;
+    mesh.vertexCount = vertexCount;
+    mesh.vertexData = vertices.data();
+    mesh.indexType = wideIndices ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16;
+    mesh.indexCount = static_cast<uint32_t>(size_t(cells) * cells * 6);
+    mesh.indexData = wideIndices ? static_cast<const void*>(indices32.data()) : static_cast<const void*>(indices16.data());
+    mesh.boundsMin = glm::vec3(-0.5f, -0.5f, 0.0f);
+    mesh.boundsMax = glm::vec3(0.5f, 0.5f, 0.0f);
+
+    snorm16Vertices.clear();
+    halfVertices.clear();
+    if(settings.vertexFormat != VertexFormat::Float){
+        mesh.quantization = VertexQuantization::fromBounds(vertices.data(), vertices.size());
+        if(settings.vertexFormat == VertexFormat::Snorm16){
+            snorm16Vertices.resize(vertices.size());
+            mesh.vertexData = snorm16Vertices.data();
+        } else{
+            halfVertices.resize(vertices.size());
+            mesh.vertexData = halfVertices.data();
+        }
+        jobs.parallelFor(vertexCount, 4096, [&](uint32_t begin, uint32_t end){
+            if(settings.vertexFormat == VertexFormat::Snorm16){
+                quantizeVertices(&vertices[begin], end - begin, mesh.quantization, &snorm16Vertices[begin]);
+            } else{
+                quantizeVertices(&vertices[begin], end - begin, mesh.quantization, &halfVertices[begin]);
+            }
+        });
+    }
+}
 
-    vertices = {Vertex({-0.5, -0.5, 0}, {1, 0, 0}),
-                Vertex({0.5, -0.5, 0}, {0, 1, 0}),
-                Vertex({0.5, 0.5, 0}, {0, 0, 1}),
-                Vertex({-0.5, 0.5, 0}, {1, 1, 1})};
-    indices = {0, 1, 3, 1, 2, 3};
+void AppVulkanCore::optimizeSceneMesh()
+{
+    // The mesh may point into a read-only mapping, so the passes work on copies
+    const char* vertexData = static_cast<const char*>(mesh.vertexData);
+    const char* indexData = static_cast<const char*>(mesh.indexData);
+    optimizedVertices.assign(vertexData, vertexData + mesh.vertexBytes());
+    optimizedIndices.assign(indexData, indexData + mesh.indexBytes());
+
+    MeshOptimizationReport report = optimizeMesh(mesh, optimizedVertices.data(), optimizedIndices.data());
+    mesh.vertexData = optimizedVertices.data();
+    mesh.indexData = optimizedIndices.data();
+    std::cout << "Mesh optimization (" << DEFAULT_VERTEX_CACHE_SIZE << " entry cache): ACMR " << report.before.acmr << " -> " << report.after.acmr
+              << ", ATVR " << report.before.atvr << " -> " << report.after.atvr
+              << ", vertices " << report.verticesBefore << " -> " << report.verticesAfter << std::endl;
 }
 
 void AppVulkanCore::run()
 {
-    initWindow();
+    if(!settings.headless){
+        initWindow();
+    }
     initVulkan();
     mainLoop();
     cleanup();
@@ -63,6 +252,9 @@ bool AppVulkanCore::isDevicesSuitable(VkPhysicalDevice device)
     auto indices = findQueueFamilies(device);
 
     bool extensionsSupported = checkDeviceExtensionsSupport(device);
+    if(settings.headless){
+        return indices.isComplete() && extensionsSupported;
+    }
 
     bool swapChainAdque = false;
     if(extensionsSupported){
@@ -88,18 +280,52 @@ bool AppVulkanCore::checkDeviceExtensionsSupport(VkPhysicalDevice device)
     return requiredExtensions.empty();
 }
 
-std::vector<const char *> AppVulkanCore::getRequiredExtensions()
+bool AppVulkanCore::checkDeviceExtensionSupport(VkPhysicalDevice device, const char *extension)
 {
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    uint32_t extensionsCount = 0;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionsCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionsCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionsCount, availableExtensions.data());
+
+    for(const auto& ext : availableExtensions){
+        if(strcmp(ext.extensionName, extension) == 0) return true;
+    }
+    return false;
+}
 
-    std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+std::vector<const char *> AppVulkanCore::getRequiredExtensions()
+{
+    std::vector<const char*> extensions;
+    if(!settings.headless){
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwExtensions;
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     if (validationLayers.size() != 0) {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
 
+    // Optional, lets the device report when a present is done with the swapchain
+    if(!settings.headless){
+        uint32_t availableCount = 0;
+        vkEnumerateInstanceExtensionProperties(nullptr, &availableCount, nullptr);
+        std::vector<VkExtensionProperties> available(availableCount);
+        vkEnumerateInstanceExtensionProperties(nullptr, &availableCount, available.data());
+
+        auto isAvailable = [&available](const char* name){
+            return std::any_of(available.begin(), available.end(), [name](const VkExtensionProperties& ext){ return strcmp(ext.extensionName, name) == 0; });
+        };
+        surfaceMaintenanceSupported = isAvailable(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME)
+                                   && isAvailable(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME);
+        if(surfaceMaintenanceSupported){
+            extensions.push_back(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME);
+            extensions.push_back(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
+        }
+    }
+
     return extensions;
 }
 
@@ -152,18 +378,36 @@ QueueFamilyIndices AppVulkanCore::findQueueFamilies(VkPhysicalDevice device)
     std::vector<VkQueueFamilyProperties> queueFamilies(queueFamiliCounter);
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamiliCounter, queueFamilies.data());
 
-    int i=0;
-    for(const auto& queueFamily : queueFamilies){
-        if(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT){
+    for(uint32_t i = 0; i < queueFamilies.size(); i++){
+        const auto& queueFamily = queueFamilies[i];
+        bool graphics = queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT;
+        bool compute = queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT;
+        bool transfer = queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT;
+
+        if(graphics && !indices.graphicsFamily.has_value()){
             indices.graphicsFamily = i;
         }
 
         VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-        if(presentSupport) indices.presentFamily = i;
+        if(surface != VK_NULL_HANDLE){
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+        }
+        if(presentSupport && (!indices.presentFamily.has_value() || indices.graphicsFamily == i)){
+            indices.presentFamily = i;
+        }
+
+        // Prefer a pure DMA family for transfers, and a compute family without graphics for async compute
+        if(transfer && !graphics && !compute && !indices.transferFamily.has_value()){
+            indices.transferFamily = i;
+        }
+        if(compute && !graphics && !indices.computeFamily.has_value()){
+            indices.computeFamily = i;
+        }
+    }
 
-        if(indices.isComplete()) break;
-        i++;
+    // Nothing is presented headless, the present queue just aliases the graphics queue
+    if(settings.headless){
+        indices.presentFamily = indices.graphicsFamily;
     }
     return indices;
 }
@@ -203,6 +447,12 @@ VkSurfaceFormatKHR AppVulkanCore::chooseSwapSurfaceFormat(const std::vector<VkSu
 
 VkPresentModeKHR AppVulkanCore::chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availableModes)
 {
+    // Benchmarks measure throughput, so do not let vsync cap the frame rate
+    if(settings.benchmarkFrames > 0){
+        for(const auto& avMode : availableModes){
+            if(avMode == VK_PRESENT_MODE_IMMEDIATE_KHR) return avMode;
+        }
+    }
     for(const auto& avMode : availableModes){
         if(avMode == VK_PRESENT_MODE_MAILBOX_KHR) return avMode;
     }
@@ -245,35 +495,52 @@ std::vector<char> AppVulkanCore::readFile(const std::string &filename)
     return buffer;
 }
 
-VkShaderModule AppVulkanCore::createShaderModule(const std::vector<char> &code)
+uint32_t AppVulkanCore::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
 {
-    VkShaderModuleCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-    VkShaderModule shaderModule;
-    if(vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS){
-        throw std::runtime_error("Failed to create shader module");
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
     }
 
-    return shaderModule;
+    throw std::runtime_error("failed to find suitable memory type!");
 }
 
-uint32_t AppVulkanCore::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+std::optional<uint32_t> AppVulkanCore::findDirectWriteMemoryType(uint32_t typeFilter)
 {
     VkPhysicalDeviceMemoryProperties memProperties;
     vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+    // Only worth it when the host visible device local heap is the main VRAM heap (UMA, ReBAR),
+    // not the small 256 MiB BAR window discrete GPUs expose without resizable BAR
+    VkDeviceSize largestDeviceHeap = 0;
+    for(uint32_t i = 0; i < memProperties.memoryHeapCount; i++){
+        if(memProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT){
+            largestDeviceHeap = std::max(largestDeviceHeap, memProperties.memoryHeaps[i].size);
+        }
+    }
+
+    VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
     for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+        const VkMemoryType& type = memProperties.memoryTypes[i];
+        if ((typeFilter & (1 << i)) && (type.propertyFlags & properties) == properties
+                && memProperties.memoryHeaps[type.heapIndex].size == largestDeviceHeap) {
             return i;
         }
     }
 
-    throw std::runtime_error("failed to find suitable memory type!");
+    return std::nullopt;
+}
+
+void AppVulkanCore::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, MemoryAllocation &bufferMemory, MemoryCategory category)
+{
+    createBuffer(size, usage, [this, properties](uint32_t typeBits){ return findMemoryType(typeBits, properties); },
+                 buffer, bufferMemory, category);
 }
 
-void AppVulkanCore::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &bufferMemory)
+void AppVulkanCore::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, const std::function<uint32_t (uint32_t)> &chooseMemoryType, VkBuffer &buffer, MemoryAllocation &bufferMemory, MemoryCategory category)
 {
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -288,58 +555,41 @@ void AppVulkanCore::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, Vk
     VkMemoryRequirements memRequirements;
     vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-    if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate vertex buffer memory!");
-    }
+    bufferMemory = memoryAllocator.allocate(memRequirements, chooseMemoryType(memRequirements.memoryTypeBits), true, category);
 
-    vkBindBufferMemory(device, buffer, bufferMemory, 0);
+    vkBindBufferMemory(device, buffer, bufferMemory.memory, bufferMemory.offset);
 }
 
-void AppVulkanCore::copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size)
+void AppVulkanCore::createStaticBuffer(const char *name, const void *data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer, MemoryAllocation &bufferMemory, MemoryCategory category)
 {
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = commandPool;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-    VkBufferCopy copyRegion{};
-    copyRegion.srcOffset = 0;
-    copyRegion.dstOffset = 0;
-    copyRegion.size = size;
-
-    vkCmdCopyBuffer(commandBuffer, src, dst, 1, &copyRegion);
-    vkEndCommandBuffer(commandBuffer);
-
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
+    std::optional<uint32_t> directType;
+    uint32_t memoryType = 0;
+    createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, [&](uint32_t typeBits){
+        directType = findDirectWriteMemoryType(typeBits);
+        memoryType = directType ? *directType : findMemoryType(typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        return memoryType;
+    }, buffer, bufferMemory, category);
+
+    if(directType.has_value()){
+        memcpy(bufferMemory.mapped, data, size);
+        std::cout << name << ": direct write into device local host visible memory (type " << memoryType << ")" << std::endl;
+    } else {
+        uploadManager.enqueueBufferUpload(buffer, 0, data, size);
+        std::cout << name << ": staged upload into device local memory (type " << memoryType << ")" << std::endl;
+    }
+}
 
-    vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(graphicsQueue);
-    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+void AppVulkanCore::destroyBuffer(VkBuffer buffer, MemoryAllocation &bufferMemory)
+{
+    vkDestroyBuffer(device, buffer, nullptr);
+    memoryAllocator.free(bufferMemory);
 }
 
 void AppVulkanCore::initWindow()
 {
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
     window = glfwCreateWindow(width, height, "Vulkan", nullptr, nullptr);
     glfwSetWindowUserPointer(window, this);
     glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
@@ -352,6 +602,9 @@ void AppVulkanCore::initVulkan()
     createSurface();
     pickPhysicalDevice();
     createLogicalDevice();
+    createMemoryAllocator();
+    createPipelineCache();
+    shaderRegistry.init(device);
     createSwapChain();
     createImageViews();
     createRenderPass();
@@ -359,13 +612,27 @@ void AppVulkanCore::initVulkan()
     createGraphicsPipeline();
     createFramebuffer();
     createCommandPool();
+    createUploadManager();
     createVertexBuffers();
     createIndexBuffers();
-    createUniformBuffers();
+    // Both uploads copied straight out of the mapping, nothing reads the mesh file after this
+    meshFile.close();
+    mesh.vertexData = nullptr;
+    mesh.indexData = nullptr;
+    if(settings.gpuCulling){
+        createCullBuffers();
+    }
+    uploadManager.flush();
+    createFrameDataBuffer();
     createDescriptorPool();
     createDescriprorSets();
+    if(settings.gpuCulling){
+        createCullPipeline();
+        createCullCommandBuffers();
+    }
     createCommandBuffers();
     createSyncObjects();
+    createProfiler();
 }
 
 void AppVulkanCore::setupDebugSender()
@@ -380,6 +647,8 @@ void AppVulkanCore::setupDebugSender()
 
 void AppVulkanCore::createSurface()
 {
+    if(settings.headless) return;
+
     if(glfwCreateWindowSurface(vkInstance, window, nullptr, &surface) != VK_SUCCESS){
         throw std::runtime_error("Failed to create window surface!");
     }
@@ -414,7 +683,8 @@ void AppVulkanCore::createLogicalDevice()
     QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value(),
+                                              indices.transferOrGraphics(), indices.computeOrGraphics()};
 
     float queuePriority = 1.0f;
     for(uint32_t queueFamily : uniqueQueueFamilies){
@@ -426,10 +696,53 @@ void AppVulkanCore::createLogicalDevice()
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+    fillModeNonSolidSupported = supportedFeatures.fillModeNonSolid == VK_TRUE;
+
     VkPhysicalDeviceFeatures deviceFeatures{};
+    deviceFeatures.fillModeNonSolid = supportedFeatures.fillModeNonSolid;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT supportedMaintenance1{};
+    supportedMaintenance1.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT;
+    bool maintenance1Available = surfaceMaintenanceSupported
+                              && checkDeviceExtensionSupport(physicalDevice, VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME);
+
+    VkPhysicalDeviceVulkan12Features supported12{};
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    supported12.pNext = maintenance1Available ? &supportedMaintenance1 : nullptr;
+    if(properties.apiVersion >= VK_API_VERSION_1_2){
+        VkPhysicalDeviceFeatures2 supportedFeatures{};
+        supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supportedFeatures.pNext = &supported12;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+    }
+    timelineSemaphoreSupported = supported12.timelineSemaphore == VK_TRUE;
+
+    VkPhysicalDeviceVulkan12Features features12{};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features12.timelineSemaphore = timelineSemaphoreSupported ? VK_TRUE : VK_FALSE;
+
+    presentFenceSupported = supportedMaintenance1.swapchainMaintenance1 == VK_TRUE;
+    VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT features1{};
+    features1.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT;
+    features1.swapchainMaintenance1 = VK_TRUE;
+    if(presentFenceSupported){
+        deviceExtensions.push_back(VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME);
+        features12.pNext = &features1;
+    }
+
+    memoryBudgetSupported = checkDeviceExtensionSupport(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if(memoryBudgetSupported){
+        deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
 
     VkDeviceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = properties.apiVersion >= VK_API_VERSION_1_2 ? &features12 : nullptr;
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.queueCreateInfoCount = queueCreateInfos.size();
     createInfo.pEnabledFeatures = &deviceFeatures;
@@ -451,11 +764,91 @@ void AppVulkanCore::createLogicalDevice()
 
     vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
     vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+    vkGetDeviceQueue(device, indices.transferOrGraphics(), 0, &transferQueue);
+    vkGetDeviceQueue(device, indices.computeOrGraphics(), 0, &computeQueue);
+    graphicsQueueFamily = indices.graphicsFamily.value();
+    computeQueueFamily = indices.computeOrGraphics();
+
+    std::cout << "Queue families: graphics " << indices.graphicsFamily.value()
+              << ", present " << indices.presentFamily.value()
+              << ", transfer " << indices.transferOrGraphics() << (indices.transferFamily.has_value() ? " (dedicated)" : " (shared)")
+              << ", compute " << indices.computeOrGraphics() << (indices.computeFamily.has_value() ? " (async)" : " (shared)") << std::endl;
+    std::cout << "Frame pacing: " << (timelineSemaphoreSupported ? "timeline semaphore" : "fences") << std::endl;
+    if(!settings.headless){
+        std::cout << "Present completion: " << (presentFenceSupported ? "present fences" : "present queue idle") << std::endl;
+    }
+
+}
+
+void AppVulkanCore::createMemoryAllocator()
+{
+    memoryAllocator.init(physicalDevice, device, memoryBudgetSupported);
+}
+
+void AppVulkanCore::createPipelineCache()
+{
+    std::vector<char> data;
+    if(!settings.pipelineCachePath.empty() && std::filesystem::exists(settings.pipelineCachePath)){
+        data = readFile(settings.pipelineCachePath);
+    }
+
+    // A cache from another driver or GPU is at best useless, so anything that does not match this device starts empty
+    if(!data.empty()){
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        uint32_t header[4] = {};
+        uint8_t uuid[VK_UUID_SIZE] = {};
+        bool valid = data.size() >= sizeof(header) + VK_UUID_SIZE;
+        if(valid){
+            memcpy(header, data.data(), sizeof(header));
+            memcpy(uuid, data.data() + sizeof(header), VK_UUID_SIZE);
+            valid = header[0] >= sizeof(header) + VK_UUID_SIZE && header[0] <= data.size()
+                    && header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+                    && header[2] == properties.vendorID && header[3] == properties.deviceID
+                    && memcmp(uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+        }
+        if(!valid){
+            std::cout << "Pipeline cache: " << settings.pipelineCachePath << " does not match this device, starting empty" << std::endl;
+            data.clear();
+        } else{
+            std::cout << "Pipeline cache: loaded " << data.size() << " bytes" << std::endl;
+        }
+    }
+
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+    if(vkCreatePipelineCache(device, &createInfo, nullptr, &pipelineCache) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create pipeline cache!");
+    }
+}
+
+void AppVulkanCore::savePipelineCache()
+{
+    if(settings.pipelineCachePath.empty()) return;
+
+    size_t size = 0;
+    if(vkGetPipelineCacheData(device, pipelineCache, &size, nullptr) != VK_SUCCESS || size == 0) return;
+    std::vector<char> data(size);
+    if(vkGetPipelineCacheData(device, pipelineCache, &size, data.data()) != VK_SUCCESS) return;
 
+    try {
+        writeFileAtomically(settings.pipelineCachePath, {{data.data(), size}});
+    }  catch (const std::exception& e) {
+        std::cerr << "Pipeline cache: " << e.what() << std::endl;
+    }
 }
 
 void AppVulkanCore::createSwapChain()
 {
+    if(settings.headless){
+        createOffscreenTargets();
+        return;
+    }
+
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
 
     VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
@@ -493,7 +886,7 @@ void AppVulkanCore::createSwapChain()
     createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE;
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    createInfo.oldSwapchain = swapChain;
 
     if(vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS){
         throw std::runtime_error("Failed to create swap chain");
@@ -507,6 +900,45 @@ void AppVulkanCore::createSwapChain()
     vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
 }
 
+void AppVulkanCore::createOffscreenTargets()
+{
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, settings.headlessFormat, &formatProperties);
+    if(!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT)){
+        throw std::runtime_error("Headless format cannot be used as a color attachment!");
+    }
+
+    swapChainImageFormat = settings.headlessFormat;
+    swapChainImageExtent = {static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
+
+    swapChainImages.resize(framesInFlight);
+    offscreenImageMemory.resize(framesInFlight);
+    for(uint32_t i = 0; i < framesInFlight; i++){
+        VkImageCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        createInfo.imageType = VK_IMAGE_TYPE_2D;
+        createInfo.format = swapChainImageFormat;
+        createInfo.extent = {swapChainImageExtent.width, swapChainImageExtent.height, 1};
+        createInfo.mipLevels = 1;
+        createInfo.arrayLayers = 1;
+        createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        createInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        if(vkCreateImage(device, &createInfo, nullptr, &swapChainImages[i]) != VK_SUCCESS){
+            throw std::runtime_error("Failed to create offscreen image!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device, swapChainImages[i], &memRequirements);
+        offscreenImageMemory[i] = memoryAllocator.allocate(memRequirements, findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+                                                           false, MemoryCategory::Image);
+        vkBindImageMemory(device, swapChainImages[i], offscreenImageMemory[i].memory, offscreenImageMemory[i].offset);
+    }
+}
+
 void AppVulkanCore::createImageViews()
 {
     swapChainImageViews.resize(swapChainImages.size());
@@ -542,7 +974,7 @@ void AppVulkanCore::createRenderPass()
     colorAttachement.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachement.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachement.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachement.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachement.finalLayout = settings.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentReference colorAttachementRef{};
     colorAttachementRef.attachment = 0;
@@ -581,7 +1013,7 @@ void AppVulkanCore::createDescriptorSetLayout()
     VkDescriptorSetLayoutBinding uboLayoutBinding{};
     uboLayoutBinding.binding = 0;
     uboLayoutBinding.descriptorCount = 1;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     uboLayoutBinding.pImmutableSamplers = nullptr;
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
@@ -597,89 +1029,6 @@ void AppVulkanCore::createDescriptorSetLayout()
 
 void AppVulkanCore::createGraphicsPipeline()
 {
-    auto vertShaderCode = readFile("shader/base.vert.spv");
-    auto fragShaderCode = readFile("shader/base.frag.spv");
-
-    VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-    VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
-
-    VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertShaderStageInfo.module = vertShaderModule;
-    vertShaderStageInfo.pName = "main";
-
-    VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-    fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module = fragShaderModule;
-    fragShaderStageInfo.pName = "main";
-
-    VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
-
-    auto binding = Vertex::getBindingDescription();
-    auto attribs = Vertex::getAttributeDescription();
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.pVertexBindingDescriptions = &binding;
-    vertexInputInfo.vertexAttributeDescriptionCount = attribs.size();
-    vertexInputInfo.pVertexAttributeDescriptions = attribs.data();
-
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.height = swapChainImageExtent.height;
-    viewport.width = swapChainImageExtent.width;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissor{};
-    scissor.offset = {0, 0};
-    scissor.extent = swapChainImageExtent;
-
-    VkPipelineViewportStateCreateInfo viewportState{};
-    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportState.viewportCount = 1;
-    viewportState.pViewports = &viewport;
-    viewportState.scissorCount = 1;
-    viewportState.pScissors = &scissor;
-
-    VkPipelineRasterizationStateCreateInfo rasterizer{};
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer.depthClampEnable = VK_FALSE;
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizer.lineWidth = 1.0f;
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-    rasterizer.depthBiasEnable = VK_FALSE;
-
-    VkPipelineMultisampleStateCreateInfo multisampling{};
-    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-    VkPipelineColorBlendAttachmentState colorBlendAttachement{};
-    colorBlendAttachement.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachement.blendEnable = VK_FALSE;
-
-    VkPipelineColorBlendStateCreateInfo colorBlending{};
-    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlending.logicOpEnable = VK_FALSE;
-    colorBlending.attachmentCount = 1;
-    colorBlending.pAttachments = &colorBlendAttachement;
-
-    VkPipelineDynamicStateCreateInfo dynamicState{};
-    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicState.dynamicStateCount = 0;
-    dynamicState.pDynamicStates = nullptr;
-
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.setLayoutCount = 1;
@@ -689,30 +1038,43 @@ void AppVulkanCore::createGraphicsPipeline()
         throw std::runtime_error("Failed to create pipeline layout");
     }
 
-    VkGraphicsPipelineCreateInfo pipelineInfo{};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = shaderStages;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssembly;
-    pipelineInfo.pViewportState = &viewportState;
-    pipelineInfo.pRasterizationState = &rasterizer;
-    pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pDepthStencilState = nullptr; // Optional
-    pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.pDynamicState = nullptr; // Optional
-    pipelineInfo.layout = pipelineLayout;
-    pipelineInfo.renderPass = renderPass;
-    pipelineInfo.subpass = 0;
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-    pipelineInfo.basePipelineIndex = -1;
-
-    if(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS){
-        throw std::runtime_error("Failed to create graphics pipeline!");
+    PipelineManager::Description description;
+    description.vertexShader = shaderRegistry.get(settings.instanced ? "base_instanced.vert" : "base.vert");
+    description.fragmentShader = shaderRegistry.get("base.frag");
+    if(mesh.vertexFormat == VertexFormat::Snorm16){
+        description.bindings = {vertexBindingDescription<Snorm16Vertex>()};
+        constexpr auto vertexAttribs = vertexAttributeDescriptions<Snorm16Vertex>();
+        description.attributes.assign(vertexAttribs.begin(), vertexAttribs.end());
+    } else if(mesh.vertexFormat == VertexFormat::Half){
+        description.bindings = {vertexBindingDescription<HalfVertex>()};
+        constexpr auto vertexAttribs = vertexAttributeDescriptions<HalfVertex>();
+        description.attributes.assign(vertexAttribs.begin(), vertexAttribs.end());
+    } else{
+        description.bindings = {vertexBindingDescription<Vertex>()};
+        constexpr auto vertexAttribs = vertexAttributeDescriptions<Vertex>();
+        description.attributes.assign(vertexAttribs.begin(), vertexAttribs.end());
+    }
+    if(settings.instanced){
+        description.bindings.push_back(vertexBindingDescription<InstanceData>());
+        constexpr auto instanceAttribs = vertexAttributeDescriptions<InstanceData>();
+        description.attributes.insert(description.attributes.end(), instanceAttribs.begin(), instanceAttribs.end());
+    }
+    description.layout = pipelineLayout;
+    pipelineManager.init(device, pipelineCache, jobs, description, renderPass);
+
+    PipelineVariant material;
+    if(settings.wireframe){
+        if(fillModeNonSolidSupported){
+            material.polygonMode = VK_POLYGON_MODE_LINE;
+        } else{
+            std::cout << "Wireframe needs fillModeNonSolid, drawing filled" << std::endl;
+        }
     }
+    material.constants[0] = settings.greyscale ? 1 : 0;
 
-    vkDestroyShaderModule(device, vertShaderModule, nullptr);
-    vkDestroyShaderModule(device, fragShaderModule, nullptr);
+    // Only the default variant blocks startup, the scene draws with it until its own variant is ready
+    defaultPipeline = pipelineManager.request(PipelineVariant(), true);
+    scenePipeline = pipelineManager.request(material);
 }
 
 void AppVulkanCore::createFramebuffer()
@@ -745,75 +1107,80 @@ void AppVulkanCore::createCommandPool()
     VkCommandPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     poolInfo.queueFamilyIndex = familyIndices.graphicsFamily.value();
-    poolInfo.flags = 0;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
     if(vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS){
         throw std::runtime_error("Failed to create command pool!");
     }
+
+    if(settings.gpuCulling){
+        poolInfo.queueFamilyIndex = computeQueueFamily;
+        if(vkCreateCommandPool(device, &poolInfo, nullptr, &computeCommandPool) != VK_SUCCESS){
+            throw std::runtime_error("Failed to create compute command pool!");
+        }
+    }
 }
 
-void AppVulkanCore::createVertexBuffers()
+void AppVulkanCore::createUploadManager()
 {
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-    void* data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, vertices.data(), bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
-
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+    QueueFamilyIndices familyIndices = findQueueFamilies(physicalDevice);
 
-    copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+    createBuffer(UPLOAD_RING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uploadRingBuffer, uploadRingBufferMemory, MemoryCategory::Staging);
+    uploadManager.init(device, transferQueue, familyIndices.transferOrGraphics(), graphicsQueue, familyIndices.graphicsFamily.value(),
+                       uploadRingBuffer, uploadRingBufferMemory.mapped, UPLOAD_RING_SIZE);
+}
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+void AppVulkanCore::createVertexBuffers()
+{
+    createStaticBuffer("Vertex buffer", mesh.vertexData, mesh.vertexBytes(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBuffer, vertexBufferMemory, MemoryCategory::Vertex);
+
+    if(!instances.empty()){
+        VkDeviceSize instanceBufferSize = sizeof(instances[0]) * instances.size();
+        // The culling pass reads the full instance list as a storage buffer
+        VkBufferUsageFlags usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | (settings.gpuCulling ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : 0);
+        createStaticBuffer("Instance buffer", instances.data(), instanceBufferSize, usage,
+                           instanceBuffer, instanceBufferMemory, MemoryCategory::Vertex);
+    }
 }
 
 void AppVulkanCore::createIndexBuffers()
 {
-    VkDeviceSize bufferSize = sizeof(indices[0])*indices.size();
-
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-    void* data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, indices.data(), bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
-
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
-    copyBuffer(stagingBuffer, indexBuffer, bufferSize);
-
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    createStaticBuffer("Index buffer", mesh.indexData, mesh.indexBytes(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBuffer, indexBufferMemory, MemoryCategory::Index);
 }
 
-void AppVulkanCore::createUniformBuffers()
+void AppVulkanCore::createFrameDataBuffer()
 {
-    VkDeviceSize bufferSize = sizeof (UniformBufferObject);
-    uniformBuffers.resize(swapChainImages.size());
-    uniformBuffersMemory.resize(swapChainImages.size());
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
 
-    for(auto i = 0; i < swapChainImages.size(); i++){
-        createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBuffersMemory[i]);
-    }
+    // Every object takes one aligned UniformBufferObject per frame, leave the rest for other transient data
+    VkDeviceSize alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+    VkDeviceSize objectStride = (sizeof(UniformBufferObject) + alignment - 1) / alignment * alignment;
+    frameDataRegionSize = std::max(FRAME_DATA_REGION_SIZE, objectStride * objectTransforms.size() + FRAME_DATA_REGION_SIZE / 2);
+
+    VkDeviceSize bufferSize = frameDataRegionSize * framesInFlight;
+    createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frameDataBuffer, frameDataBufferMemory, MemoryCategory::Uniform);
+
+    frameAllocator.init(frameDataBuffer, frameDataBufferMemory.mapped, frameDataRegionSize, framesInFlight,
+                        properties.limits.minUniformBufferOffsetAlignment);
 }
 
 void AppVulkanCore::createDescriptorPool()
 {
-    VkDescriptorPoolSize poolSize{};
-    poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSize.descriptorCount = swapChainImages.size();
+    std::vector<VkDescriptorPoolSize> poolSizes(1);
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSizes[0].descriptorCount = 1;
+    if(settings.gpuCulling){
+        poolSizes.push_back({VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2});
+        poolSizes.push_back({VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 2});
+    }
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = 1;
-    poolInfo.pPoolSizes = &poolSize;
-    poolInfo.maxSets = swapChainImages.size();
+    poolInfo.poolSizeCount = poolSizes.size();
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = settings.gpuCulling ? 2 : 1;
 
     if(vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS){
         throw std::runtime_error("Failed to create descriptor pool");
@@ -822,40 +1189,130 @@ void AppVulkanCore::createDescriptorPool()
 
 void AppVulkanCore::createDescriprorSets()
 {
-    std::vector<VkDescriptorSetLayout> layouts(swapChainImages.size(), descriptorSetLayout);
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = swapChainImages.size();
-    allocInfo.pSetLayouts = layouts.data();
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &descriptorSetLayout;
 
-    descriptorSets.resize(swapChainImages.size());
-    if(vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS){
+    if(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS){
         throw std::runtime_error("Failed to allocate descriptor sets");
     }
 
-    for(auto i = 0; i < swapChainImages.size(); i++){
-        VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffers[i];
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(UniformBufferObject);
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = frameDataBuffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range = sizeof(UniformBufferObject);
+
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = descriptorSet;
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &bufferInfo;
+
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+}
+
+void AppVulkanCore::createCullBuffers()
+{
+    VkDeviceSize boundsSize = sizeof(instanceBounds[0]) * instanceBounds.size();
+    createStaticBuffer("Bounds buffer", instanceBounds.data(), boundsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                       boundsBuffer, boundsBufferMemory, MemoryCategory::Other);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    VkDeviceSize alignment = std::max<VkDeviceSize>(properties.limits.minStorageBufferOffsetAlignment, 4);
+    auto align = [alignment](VkDeviceSize size){ return (size + alignment - 1) / alignment * alignment; };
+
+    // Each frame slot gets its own command and visible list, so culling never races a frame still in flight
+    cullVisibleOffset = align(sizeof(VkDrawIndexedIndirectCommand));
+    cullRegionSize = cullVisibleOffset + align(sizeof(InstanceData) * instances.size());
+    createBuffer(cullRegionSize * framesInFlight,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, cullOutputBuffer, cullOutputBufferMemory, MemoryCategory::Vertex);
+}
+
+void AppVulkanCore::createCullPipeline()
+{
+    std::array<VkDescriptorSetLayoutBinding, 4> bindings{};
+    VkDescriptorType types[] = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC};
+    for(uint32_t i = 0; i < bindings.size(); i++){
+        bindings[i].binding = i;
+        bindings[i].descriptorCount = 1;
+        bindings[i].descriptorType = types[i];
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = bindings.size();
+    layoutInfo.pBindings = bindings.data();
+    if(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &cullDescriptorSetLayout) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create culling descriptor set layout");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &cullDescriptorSetLayout;
+    if(vkAllocateDescriptorSets(device, &allocInfo, &cullDescriptorSet) != VK_SUCCESS){
+        throw std::runtime_error("Failed to allocate culling descriptor set");
+    }
+
+    // The output bindings cover one frame slot, the dynamic offset picks the slot
+    VkDescriptorBufferInfo bufferInfos[4] = {
+        {boundsBuffer, 0, VK_WHOLE_SIZE},
+        {instanceBuffer, 0, VK_WHOLE_SIZE},
+        {cullOutputBuffer, 0, sizeof(VkDrawIndexedIndirectCommand)},
+        {cullOutputBuffer, cullVisibleOffset, cullRegionSize - cullVisibleOffset},
+    };
+    std::array<VkWriteDescriptorSet, 4> writes{};
+    for(uint32_t i = 0; i < writes.size(); i++){
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = cullDescriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorType = types[i];
+        writes[i].descriptorCount = 1;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(device, writes.size(), writes.data(), 0, nullptr);
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullPushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &cullDescriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &cullPipelineLayout) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create culling pipeline layout");
+    }
 
-        VkWriteDescriptorSet descriptorWrite{};
-        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrite.dstSet = descriptorSets[i];
-        descriptorWrite.dstBinding = 0;
-        descriptorWrite.dstArrayElement = 0;
-        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrite.descriptorCount = 1;
-        descriptorWrite.pBufferInfo = &bufferInfo;
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderRegistry.get("cull.comp");
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = cullPipelineLayout;
 
-        vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+    if(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &cullPipeline) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create culling pipeline!");
     }
 }
 
 void AppVulkanCore::createCommandBuffers()
 {
-    commandBuffers.resize(swapChainFramebuffers.size());
+    commandBuffers.resize(framesInFlight);
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.commandPool = commandPool;
@@ -866,70 +1323,464 @@ void AppVulkanCore::createCommandBuffers()
         throw std::runtime_error("Failed to allocate command buffer!");
     }
 
-    for(size_t i = 0; i < commandBuffers.size(); i++){
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = 0;
+    if(recordThreadCount <= 1) return;
 
-        if(vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS){
-            throw std::runtime_error("Failed to begin recording command buffer!");
-        }
+    // One transient pool per recording thread and frame slot, pools are not thread safe
+    QueueFamilyIndices familyIndices = findQueueFamilies(physicalDevice);
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = familyIndices.graphicsFamily.value();
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
 
-        VkRenderPassBeginInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = renderPass;
-        renderPassInfo.framebuffer = swapChainFramebuffers[i];
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = swapChainImageExtent;
+    secondaryCommandPools.resize(framesInFlight * recordThreadCount);
+    secondaryCommandBuffers.resize(secondaryCommandPools.size());
+    for(size_t i = 0; i < secondaryCommandPools.size(); i++){
+        if(vkCreateCommandPool(device, &poolInfo, nullptr, &secondaryCommandPools[i]) != VK_SUCCESS){
+            throw std::runtime_error("Failed to create secondary command pool!");
+        }
 
-        VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-        renderPassInfo.clearValueCount = 1;
-        renderPassInfo.pClearValues = &clearColor;
+        VkCommandBufferAllocateInfo secondaryAllocInfo{};
+        secondaryAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        secondaryAllocInfo.commandPool = secondaryCommandPools[i];
+        secondaryAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        secondaryAllocInfo.commandBufferCount = 1;
+        if(vkAllocateCommandBuffers(device, &secondaryAllocInfo, &secondaryCommandBuffers[i]) != VK_SUCCESS){
+            throw std::runtime_error("Failed to allocate secondary command buffer!");
+        }
+    }
+}
 
-        vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+void AppVulkanCore::buildRenderQueue()
+{
+    renderQueue.clear();
+
+    // The synthetic scene has a single material and mesh, so only depth orders the draws
+    DrawItem item;
+    item.pipeline = pipelineManager.get(scenePipeline, defaultPipeline);
+    item.pipelineLayout = pipelineLayout;
+    item.descriptorSet = descriptorSet;
+    item.vertexBuffer = vertexBuffer;
+    item.indexBuffer = indexBuffer;
+    item.indexType = mesh.indexType;
+    item.indexCount = mesh.indexCount;
+    if(settings.gpuCulling){
+        item.instanceBuffer = cullOutputBuffer;
+        item.instanceOffset = cullRegionSize * currentFrame + cullVisibleOffset;
+        item.indirectBuffer = cullOutputBuffer;
+        item.indirectOffset = cullRegionSize * currentFrame;
+    } else if(!instances.empty()){
+        item.instanceBuffer = instanceBuffer;
+        item.instanceCount = static_cast<uint32_t>(instances.size());
+    }
 
-        vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    for(size_t i = 0; i < objectTransforms.size(); i++){
+        glm::vec4 center = viewMatrix * objectTransforms[i] * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        item.key = RenderQueue::makeSortKey(scenePipeline, 0, 0, -center.z);
+        item.uniformOffset = objectUniformOffsets[i];
+        renderQueue.submit(item);
+    }
+    renderQueue.sort();
+}
 
-        VkBuffer vertexBuffers[] = {vertexBuffer};
-        VkDeviceSize offsets[] = {0};
-        vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
+void AppVulkanCore::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-        vkCmdBindIndexBuffer(commandBuffers[i], indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+    if(vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS){
+        throw std::runtime_error("Failed to begin recording command buffer!");
+    }
+    profiler.resetGpuQueries(commandBuffer, currentFrame);
+    if(settings.gpuCulling && computeQueueFamily != graphicsQueueFamily){
+        // Acquire half of the release at the end of submitCulling()
+        VkBufferMemoryBarrier acquire = cullOutputOwnershipBarrier();
+        acquire.srcAccessMask = 0;
+        acquire.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                             VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &acquire, 0, nullptr);
+    }
 
-        vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[i], 0, nullptr);
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = renderPass;
+    renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = swapChainImageExtent;
+
+    VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
+    renderPassInfo.clearValueCount = 1;
+    renderPassInfo.pClearValues = &clearColor;
+
+    // Small draw lists are cheaper to record inline than to fan out
+    size_t drawCount = renderQueue.size();
+    uint32_t chunkCount = static_cast<uint32_t>(std::min<size_t>(recordThreadCount, (drawCount + MIN_DRAWS_PER_CHUNK - 1) / MIN_DRAWS_PER_CHUNK));
+
+    uint32_t gpuScope = profiler.beginGpuScope(commandBuffer, currentFrame, "render pass");
+    if(chunkCount <= 1){
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        renderQueueStats += recordDraws(commandBuffer, 0, drawCount);
+    } else{
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+        size_t chunkSize = (drawCount + chunkCount - 1) / chunkCount;
+        std::vector<RenderQueueStats> chunkStats(chunkCount);
+        jobs.parallelFor(chunkCount, 1, [&](uint32_t begin, uint32_t end){
+            for(uint32_t chunk = begin; chunk < end; chunk++){
+                size_t first = chunk * chunkSize;
+                size_t count = std::min(chunkSize, drawCount - first);
+                chunkStats[chunk] = recordSecondaryCommandBuffer(chunk, imageIndex, first, count);
+            }
+        });
+        for(const RenderQueueStats& stats : chunkStats){
+            renderQueueStats += stats;
+        }
 
-        vkCmdDrawIndexed(commandBuffers[i], indices.size(), 1, 0, 0, 0);
+        vkCmdExecuteCommands(commandBuffer, chunkCount, &secondaryCommandBuffers[currentFrame * recordThreadCount]);
+    }
 
-        vkCmdEndRenderPass(commandBuffers[i]);
-        if(vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS){
-            throw std::runtime_error("Failed to record command buffer!");
-        }
+    vkCmdEndRenderPass(commandBuffer);
+    profiler.endGpuScope(commandBuffer, currentFrame, gpuScope);
+    if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS){
+        throw std::runtime_error("Failed to record command buffer!");
     }
 }
 
-void AppVulkanCore::createSyncObjects()
+void AppVulkanCore::createCullCommandBuffers()
 {
-    VkSemaphoreCreateInfo semCreateInfo{};
-    semCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-
+    computeCommandBuffers.resize(framesInFlight);
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = computeCommandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = computeCommandBuffers.size();
+    if(vkAllocateCommandBuffers(device, &allocInfo, computeCommandBuffers.data()) != VK_SUCCESS){
+        throw std::runtime_error("Failed to allocate culling command buffers!");
+    }
+
+    VkSemaphoreCreateInfo semCreateInfo{};
+    semCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    cullFinishedSemaphores.resize(framesInFlight);
+    for(size_t i = 0; i < framesInFlight; i++){
+        if(vkCreateSemaphore(device, &semCreateInfo, nullptr, &cullFinishedSemaphores[i]) != VK_SUCCESS){
+            throw std::runtime_error("Failed to create sync objects!");
+        }
+    }
+
+    if(computeQueueFamily == graphicsQueueFamily) return;
+
+    // The culling inputs were uploaded for the graphics family and only the compute pass reads
+    // them from now on, so they are handed over once
+    VkBuffer inputs[] = {boundsBuffer, instanceBuffer};
+    std::array<VkBufferMemoryBarrier, 2> barriers{};
+    for(size_t i = 0; i < barriers.size(); i++){
+        barriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barriers[i].srcQueueFamilyIndex = graphicsQueueFamily;
+        barriers[i].dstQueueFamilyIndex = computeQueueFamily;
+        barriers[i].buffer = inputs[i];
+        barriers[i].offset = 0;
+        barriers[i].size = VK_WHOLE_SIZE;
+    }
+
+    VkCommandBuffer release, acquire;
+    VkCommandBufferAllocateInfo releaseAllocInfo = allocInfo;
+    releaseAllocInfo.commandPool = commandPool;
+    releaseAllocInfo.commandBufferCount = 1;
+    allocInfo.commandBufferCount = 1;
+    VkSemaphore released;
+    if(vkAllocateCommandBuffers(device, &releaseAllocInfo, &release) != VK_SUCCESS ||
+            vkAllocateCommandBuffers(device, &allocInfo, &acquire) != VK_SUCCESS ||
+            vkCreateSemaphore(device, &semCreateInfo, nullptr, &released) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create culling ownership transfer objects!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(release, &beginInfo);
+    vkCmdPipelineBarrier(release, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                         0, nullptr, barriers.size(), barriers.data(), 0, nullptr);
+    vkEndCommandBuffer(release);
+
+    for(auto& barrier : barriers){
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    }
+    vkBeginCommandBuffer(acquire, &beginInfo);
+    vkCmdPipelineBarrier(acquire, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         0, nullptr, barriers.size(), barriers.data(), 0, nullptr);
+    vkEndCommandBuffer(acquire);
+
+    VkSubmitInfo releaseInfo{};
+    releaseInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    releaseInfo.commandBufferCount = 1;
+    releaseInfo.pCommandBuffers = &release;
+    releaseInfo.signalSemaphoreCount = 1;
+    releaseInfo.pSignalSemaphores = &released;
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkSubmitInfo acquireInfo{};
+    acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    acquireInfo.waitSemaphoreCount = 1;
+    acquireInfo.pWaitSemaphores = &released;
+    acquireInfo.pWaitDstStageMask = &waitStage;
+    acquireInfo.commandBufferCount = 1;
+    acquireInfo.pCommandBuffers = &acquire;
+
+    if(vkQueueSubmit(graphicsQueue, 1, &releaseInfo, VK_NULL_HANDLE) != VK_SUCCESS ||
+            vkQueueSubmit(computeQueue, 1, &acquireInfo, VK_NULL_HANDLE) != VK_SUCCESS){
+        throw std::runtime_error("Failed to hand the culling inputs to the compute queue!");
+    }
+    vkQueueWaitIdle(computeQueue);
+    vkFreeCommandBuffers(device, commandPool, 1, &release);
+    vkFreeCommandBuffers(device, computeCommandPool, 1, &acquire);
+    vkDestroySemaphore(device, released, nullptr);
+}
+
+VkBufferMemoryBarrier AppVulkanCore::cullOutputOwnershipBarrier() const
+{
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = computeQueueFamily;
+    barrier.dstQueueFamilyIndex = graphicsQueueFamily;
+    barrier.buffer = cullOutputBuffer;
+    barrier.offset = cullRegionSize * currentFrame;
+    barrier.size = cullRegionSize;
+    return barrier;
+}
+
+void AppVulkanCore::submitCulling()
+{
+    VkCommandBuffer commandBuffer = computeCommandBuffers[currentFrame];
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if(vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS){
+        throw std::runtime_error("Failed to begin recording culling command buffer!");
+    }
+
+    // The slot's last frame has retired, so nothing reads its region any more. The region ended that
+    // frame owned by the graphics family, but it is rewritten from scratch here and its old contents
+    // are not needed, so it is taken back without an ownership transfer.
+    VkDeviceSize regionOffset = cullRegionSize * currentFrame;
+
+    // Restart the slot's command with no instances, the compute pass appends the visible ones
+    VkDrawIndexedIndirectCommand drawCommand{};
+    drawCommand.indexCount = mesh.indexCount;
+    vkCmdUpdateBuffer(commandBuffer, cullOutputBuffer, regionOffset, sizeof(drawCommand), &drawCommand);
+
+    VkBufferMemoryBarrier resetBarrier{};
+    resetBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    resetBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    resetBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    resetBarrier.buffer = cullOutputBuffer;
+    resetBarrier.offset = regionOffset;
+    resetBarrier.size = sizeof(drawCommand);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &resetBarrier, 0, nullptr);
+
+    uint32_t dynamicOffsets[] = {static_cast<uint32_t>(regionOffset), static_cast<uint32_t>(regionOffset)};
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullDescriptorSet, 2, dynamicOffsets);
+    vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cullConstants), &cullConstants);
+    vkCmdDispatch(commandBuffer, (cullConstants.objectCount + 63) / 64, 1, 1);
+
+    // The semaphore the draw waits on makes the output visible, a separate compute family also has
+    // to release the region, recordCommandBuffer() acquires it
+    if(computeQueueFamily != graphicsQueueFamily){
+        VkBufferMemoryBarrier release = cullOutputOwnershipBarrier();
+        release.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        release.dstAccessMask = 0;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                             0, 0, nullptr, 1, &release, 0, nullptr);
+    }
+    if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS){
+        throw std::runtime_error("Failed to record culling command buffer!");
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &cullFinishedSemaphores[currentFrame];
+    if(vkQueueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS){
+        throw std::runtime_error("Failed to submit culling command buffer!");
+    }
+}
+
+RenderQueueStats AppVulkanCore::recordSecondaryCommandBuffer(uint32_t chunk, uint32_t imageIndex, size_t first, size_t count)
+{
+    FrameProfiler::Scope scope(profiler, "record chunk");
+
+    // Each chunk owns a pool per frame slot, and the slot has retired, so the whole pool can be reset
+    size_t index = currentFrame * recordThreadCount + chunk;
+    vkResetCommandPool(device, secondaryCommandPools[index], 0);
+    VkCommandBuffer commandBuffer = secondaryCommandBuffers[index];
+
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = swapChainFramebuffers[imageIndex];
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    if(vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS){
+        throw std::runtime_error("Failed to begin recording secondary command buffer!");
+    }
+    RenderQueueStats stats = recordDraws(commandBuffer, first, count);
+    if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS){
+        throw std::runtime_error("Failed to record secondary command buffer!");
+    }
+    return stats;
+}
+
+RenderQueueStats AppVulkanCore::recordDraws(VkCommandBuffer commandBuffer, size_t first, size_t count)
+{
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.height = swapChainImageExtent.height;
+    viewport.width = swapChainImageExtent.width;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = swapChainImageExtent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    return renderQueue.record(commandBuffer, first, count);
+}
+
+void AppVulkanCore::createSyncObjects()
+{
+    VkSemaphoreCreateInfo semCreateInfo{};
+    semCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    imageAvailableSemaphores.resize(framesInFlight);
+    frameSubmitValues.assign(framesInFlight, 0);
+
+    for(size_t i = 0; i<framesInFlight; i++){
+        if(vkCreateSemaphore(device, &semCreateInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS){
+            throw std::runtime_error("Failed to create sync objects!");
+        }
+    }
+    if(!settings.headless){
+        createRenderFinishedSemaphores();
+    }
+
+    if(timelineSemaphoreSupported){
+        VkSemaphoreTypeCreateInfo typeCreateInfo{};
+        typeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeCreateInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo timelineCreateInfo{};
+        timelineCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        timelineCreateInfo.pNext = &typeCreateInfo;
+
+        if(vkCreateSemaphore(device, &timelineCreateInfo, nullptr, &frameTimeline) != VK_SUCCESS){
+            throw std::runtime_error("Failed to create frame timeline semaphore!");
+        }
+        return;
+    }
+
     VkFenceCreateInfo fencCreateInfo{};
     fencCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
     fencCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-    imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-    imagesInFlight.resize(swapChainImages.size(), VK_NULL_HANDLE);
+    inFlightFences.resize(framesInFlight);
+    for(size_t i = 0; i<framesInFlight; i++){
+        if(vkCreateFence(device, &fencCreateInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS){
+            throw std::runtime_error("Failed to create sync objects!");
+        }
+    }
+}
 
-    for(size_t i = 0; i<MAX_FRAMES_IN_FLIGHT; i++){
-        if(vkCreateSemaphore(device, &semCreateInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-                vkCreateSemaphore(device, &semCreateInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-                vkCreateFence(device, &fencCreateInfo, nullptr, &inFlightFences[i])){
+void AppVulkanCore::createRenderFinishedSemaphores()
+{
+    VkSemaphoreCreateInfo semCreateInfo{};
+    semCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    renderFinishedSemaphores.resize(swapChainImages.size());
+    for(size_t i = 0; i < renderFinishedSemaphores.size(); i++){
+        if(vkCreateSemaphore(device, &semCreateInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS){
             throw std::runtime_error("Failed to create sync objects!");
         }
     }
 }
 
+void AppVulkanCore::createProfiler()
+{
+    QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+    profiler.initGpu(physicalDevice, device, indices.graphicsFamily.value(), framesInFlight);
+}
+
+void AppVulkanCore::finishProfiling()
+{
+    if(!profiler.isEnabled()) return;
+
+    for(uint32_t i = 0; i < framesInFlight; i++){
+        profiler.collectGpu(i);
+    }
+    if(settings.profile){
+        profiler.printPercentiles(std::cout);
+    }
+    if(!settings.tracePath.empty()){
+        profiler.writeChromeTrace(settings.tracePath);
+        std::cout << "Trace written to " << settings.tracePath << std::endl;
+    }
+}
+
+uint64_t AppVulkanCore::completedFrameValue()
+{
+    if(!timelineSemaphoreSupported){
+        // Without a timeline the fences only say which slots are idle, report the oldest value still pending
+        uint64_t completed = frameTimelineValue;
+        for(size_t i = 0; i<framesInFlight; i++){
+            if(frameSubmitValues[i] != 0 && vkGetFenceStatus(device, inFlightFences[i]) != VK_SUCCESS){
+                completed = std::min(completed, frameSubmitValues[i] - 1);
+            }
+        }
+        return completed;
+    }
+
+    uint64_t value = 0;
+    if(vkGetSemaphoreCounterValue(device, frameTimeline, &value) != VK_SUCCESS){
+        throw std::runtime_error("Failed to query frame timeline!");
+    }
+    return value;
+}
+
+void AppVulkanCore::waitForFrameValue(uint64_t value)
+{
+    if(value == 0 || completedFrameValue() >= value) return;
+
+    if(!timelineSemaphoreSupported){
+        for(size_t i = 0; i<framesInFlight; i++){
+            if(frameSubmitValues[i] != 0 && frameSubmitValues[i] <= value){
+                vkWaitForFences(device, 1, &inFlightFences[i], VK_TRUE, UINT64_MAX);
+            }
+        }
+        return;
+    }
+
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &frameTimeline;
+    waitInfo.pValues = &value;
+    if(vkWaitSemaphores(device, &waitInfo, UINT64_MAX) != VK_SUCCESS){
+        throw std::runtime_error("Failed to wait for frame timeline!");
+    }
+}
+
 void AppVulkanCore::createInstance()
 {
     if(validationLayers.size() != 0 && !checkValidationLayerSupport()){
@@ -977,60 +1828,385 @@ void AppVulkanCore::recreateSwapChain()
         glfwGetFramebufferSize(window, &width, &height);
         glfwWaitEvents();
     }
-    vkDeviceWaitIdle(device);
 
-    cleanupSwapChain();
+    // Frames already submitted keep using the old objects, so they are only retired here and
+    // destroyed once the timeline passes the last submission. The old swapchain is handed to
+    // its replacement and may still have presents pending, which the timeline does not track.
+    // Those are waited for through their present fences, or by idling the present queue once
+    // when the device has none. They also wait on the render finished semaphores, so the new
+    // images get a fresh set.
+    uint64_t retireValue = frameTimelineValue;
+    std::vector<VkFramebuffer> oldFramebuffers;
+    std::vector<VkImageView> oldImageViews;
+    std::vector<VkSemaphore> oldRenderFinishedSemaphores;
+    oldFramebuffers.swap(swapChainFramebuffers);
+    oldImageViews.swap(swapChainImageViews);
+    oldRenderFinishedSemaphores.swap(renderFinishedSemaphores);
+    VkSwapchainKHR oldSwapChain = swapChain;
+    std::vector<VkFence> oldPresentFences;
+    for(auto it = pendingPresents.begin(); it != pendingPresents.end();){
+        if(it->swapChain == oldSwapChain){
+            oldPresentFences.push_back(it->fence);
+            it = pendingPresents.erase(it);
+        } else{
+            ++it;
+        }
+    }
+    VkFormat oldFormat = swapChainImageFormat;
 
     createSwapChain();
     createImageViews();
-    createRenderPass();
-    createGraphicsPipeline();
+    createRenderFinishedSemaphores();
+
+    VkDevice device = this->device;
+    VkQueue presentQueue = presentFenceSupported ? VK_NULL_HANDLE : this->presentQueue;
+    deletionQueue.push(retireValue, [device, presentQueue, oldPresentFences, oldFramebuffers, oldImageViews, oldRenderFinishedSemaphores, oldSwapChain](){
+        if(!oldPresentFences.empty()){
+            vkWaitForFences(device, oldPresentFences.size(), oldPresentFences.data(), VK_TRUE, UINT64_MAX);
+            for(auto fence : oldPresentFences){
+                vkDestroyFence(device, fence, nullptr);
+            }
+        }
+        if(presentQueue != VK_NULL_HANDLE){
+            vkQueueWaitIdle(presentQueue);
+        }
+        for(auto framebuffer : oldFramebuffers){
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        }
+        for(auto imageView : oldImageViews){
+            vkDestroyImageView(device, imageView, nullptr);
+        }
+        vkDestroySwapchainKHR(device, oldSwapChain, nullptr);
+        for(auto semaphore : oldRenderFinishedSemaphores){
+            vkDestroySemaphore(device, semaphore, nullptr);
+        }
+    });
+
+    // The render pass and pipeline only depend on the image format, which a resize normally keeps
+    if(swapChainImageFormat != oldFormat){
+        VkRenderPass oldRenderPass = renderPass;
+        createRenderPass();
+        std::vector<VkPipeline> oldPipelines = pipelineManager.setRenderPass(renderPass);
+        deletionQueue.push(retireValue, [device, oldPipelines, oldRenderPass](){
+            for(auto pipeline : oldPipelines){
+                vkDestroyPipeline(device, pipeline, nullptr);
+            }
+            vkDestroyRenderPass(device, oldRenderPass, nullptr);
+        });
+    }
     createFramebuffer();
-    createUniformBuffers();
-    createDescriptorPool();
-    createDescriprorSets();
-    createCommandBuffers();
+}
+
+VkFence AppVulkanCore::acquirePresentFence()
+{
+    // Only the oldest presents are checked, one finishing early is picked up on a later call
+    while(!pendingPresents.empty() && vkGetFenceStatus(device, pendingPresents.front().fence) == VK_SUCCESS){
+        VkFence fence = pendingPresents.front().fence;
+        pendingPresents.pop_front();
+        vkResetFences(device, 1, &fence);
+        freePresentFences.push_back(fence);
+    }
+
+    if(!freePresentFences.empty()){
+        VkFence fence = freePresentFences.back();
+        freePresentFences.pop_back();
+        return fence;
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VkFence fence;
+    if(vkCreateFence(device, &fenceInfo, nullptr, &fence) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create present fence!");
+    }
+    return fence;
 }
 
 void AppVulkanCore::mainLoop()
 {
-    while(!glfwWindowShouldClose(window)){
-        glfwPollEvents();
+    auto lastMemoryReport = std::chrono::steady_clock::now();
+    auto benchmarkStart = std::chrono::steady_clock::now();
+    uint32_t frameCount = 0;
+    while(settings.headless || !glfwWindowShouldClose(window)){
+        if(!settings.headless){
+            glfwPollEvents();
+        }
         drawFrame();
+
+        frameCount++;
+        // Without a window there is nothing to close, so a headless run outside a benchmark renders one frame
+        if(settings.headless && settings.benchmarkFrames == 0){
+            break;
+        }
+        if(settings.benchmarkFrames > 0 && frameCount >= settings.benchmarkFrames){
+            vkDeviceWaitIdle(device);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - benchmarkStart).count();
+            runReport.seconds = seconds;
+            std::cout << "Benchmark: " << frameCount << " frames with " << framesInFlight << " frames in flight and "
+                      << settings.simulatedCpuLoad << " ms CPU load in " << seconds << " s, "
+                      << seconds * 1000.0 / frameCount << " ms/frame, " << frameCount / seconds << " FPS" << std::endl;
+            break;
+        }
+
+        if(settings.memoryReportInterval > 0){
+            auto now = std::chrono::steady_clock::now();
+            if(std::chrono::duration<double>(now - lastMemoryReport).count() >= settings.memoryReportInterval){
+                lastMemoryReport = now;
+                reportMemory();
+            }
+        }
     }
 
     vkDeviceWaitIdle(device);
+    finishProfiling();
+
+    runReport.framesInFlight = framesInFlight;
+    runReport.frames = frameCount;
+    if(runReport.seconds == 0.0){
+        runReport.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - benchmarkStart).count();
+    }
+    runReport.stages = profiler.computeTimings();
+    runReport.memory = memoryAllocator.getReport();
+    runReport.renderQueue = renderQueueStats;
+    if(settings.profile || settings.benchmarkFrames > 0){
+        std::cout << "Render queue: " << renderQueueStats.draws << " draws, " << renderQueueStats.pipelineBinds << " pipeline, "
+                  << renderQueueStats.descriptorBinds << " descriptor, " << renderQueueStats.vertexBufferBinds << " vertex and "
+                  << renderQueueStats.indexBufferBinds << " index buffer binds, " << renderQueueStats.bindsSkipped << " redundant binds skipped" << std::endl;
+    }
+
+    if(settings.headless && !settings.capturePath.empty()){
+        writeFramePpm(settings.capturePath);
+    }
+}
+
+void AppVulkanCore::reportMemory()
+{
+    if(settings.memoryReportPath.empty()){
+        memoryAllocator.printReport(std::cout);
+        return;
+    }
+
+    std::ofstream file(settings.memoryReportPath, std::ios::app);
+    if(!file.is_open()){
+        throw std::runtime_error("Failed to open memory report file!");
+    }
+    auto seconds = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+    file << "{\"time\":" << std::fixed << seconds << ",\"memory\":";
+    memoryAllocator.writeReportJson(file);
+    file << "}" << std::endl;
+}
+
+void AppVulkanCore::simulateCpuLoad()
+{
+    if(settings.simulatedCpuLoad <= 0) return;
+
+    auto end = std::chrono::steady_clock::now() + std::chrono::duration<double, std::milli>(settings.simulatedCpuLoad);
+    while(std::chrono::steady_clock::now() < end){
+    }
+}
+
+std::vector<uint8_t> AppVulkanCore::readbackFrame()
+{
+    if(!settings.headless){
+        throw std::runtime_error("Frame readback is only available in headless mode!");
+    }
+    bool bgra = swapChainImageFormat == VK_FORMAT_B8G8R8A8_UNORM || swapChainImageFormat == VK_FORMAT_B8G8R8A8_SRGB;
+    bool rgba = swapChainImageFormat == VK_FORMAT_R8G8B8A8_UNORM || swapChainImageFormat == VK_FORMAT_R8G8B8A8_SRGB;
+    if(!bgra && !rgba){
+        throw std::runtime_error("Frame readback supports only 8-bit RGBA and BGRA formats!");
+    }
+
+    waitForFrameValue(frameTimelineValue);
+
+    VkDeviceSize size = static_cast<VkDeviceSize>(swapChainImageExtent.width) * swapChainImageExtent.height * 4;
+    VkBuffer readbackBuffer;
+    MemoryAllocation readbackMemory;
+    createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 readbackBuffer, readbackMemory, MemoryCategory::Staging);
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    if(vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS){
+        throw std::runtime_error("Failed to allocate readback command buffer!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    // The render pass already left the image in TRANSFER_SRC_OPTIMAL, only its writes need to be made visible
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = swapChainImages[lastImageIndex];
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent = {swapChainImageExtent.width, swapChainImageExtent.height, 1};
+    vkCmdCopyImageToBuffer(commandBuffer, swapChainImages[lastImageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, 1, &region);
+
+    VkBufferMemoryBarrier hostBarrier{};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.buffer = readbackBuffer;
+    hostBarrier.offset = 0;
+    hostBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                         0, nullptr, 1, &hostBarrier, 0, nullptr);
+
+    if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS){
+        throw std::runtime_error("Failed to record readback command buffer!");
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    if(vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS){
+        throw std::runtime_error("Failed to submit readback command buffer!");
+    }
+    // Readback is an explicit request, stalling the queue here is acceptable
+    vkQueueWaitIdle(graphicsQueue);
+    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+
+    std::vector<uint8_t> pixels(size);
+    memcpy(pixels.data(), readbackMemory.mapped, size);
+    destroyBuffer(readbackBuffer, readbackMemory);
+
+    if(bgra){
+        for(size_t i = 0; i < pixels.size(); i += 4){
+            std::swap(pixels[i], pixels[i + 2]);
+        }
+    }
+    return pixels;
+}
+
+void AppVulkanCore::writeFramePpm(const std::string &path)
+{
+    std::vector<uint8_t> pixels = readbackFrame();
+
+    std::ofstream file(path, std::ios::binary);
+    if(!file.is_open()){
+        throw std::runtime_error("Failed to open capture file!");
+    }
+    file << "P6\n" << swapChainImageExtent.width << " " << swapChainImageExtent.height << "\n255\n";
+    for(size_t i = 0; i < pixels.size(); i += 4){
+        file.write(reinterpret_cast<const char*>(&pixels[i]), 3);
+    }
+    std::cout << "Captured frame to " << path << std::endl;
+}
+
+const RunReport &AppVulkanCore::getRunReport() const
+{
+    return runReport;
+}
 
+MemoryReport AppVulkanCore::getMemoryReport() const
+{
+    return memoryAllocator.getReport();
 }
 
 void AppVulkanCore::cleanup()
 {
+    // The old swapchains retired in the deletion queue wait for their own presents
+    deletionQueue.flush();
+    for(const auto& present : pendingPresents){
+        vkWaitForFences(device, 1, &present.fence, VK_TRUE, UINT64_MAX);
+        vkDestroyFence(device, present.fence, nullptr);
+    }
+    for(auto fence : freePresentFences){
+        vkDestroyFence(device, fence, nullptr);
+    }
     cleanupSwapChain();
+    pipelineManager.destroy();
+    shaderRegistry.destroy();
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    vkDestroyRenderPass(device, renderPass, nullptr);
+
+    if(cullPipeline != VK_NULL_HANDLE){
+        vkDestroyPipeline(device, cullPipeline, nullptr);
+        vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, cullDescriptorSetLayout, nullptr);
+    }
 
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
     vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
-    vkDestroyBuffer(device, indexBuffer, nullptr);
-    vkFreeMemory(device, indexBufferMemory, nullptr);
-    vkDestroyBuffer(device, vertexBuffer, nullptr);
-    vkFreeMemory(device, vertexBufferMemory, nullptr);
+    uploadManager.destroy();
+    destroyBuffer(uploadRingBuffer, uploadRingBufferMemory);
+    destroyBuffer(frameDataBuffer, frameDataBufferMemory);
+    destroyBuffer(indexBuffer, indexBufferMemory);
+    destroyBuffer(vertexBuffer, vertexBufferMemory);
+    if(!instances.empty()){
+        destroyBuffer(instanceBuffer, instanceBufferMemory);
+    }
+    if(settings.gpuCulling){
+        destroyBuffer(boundsBuffer, boundsBufferMemory);
+        destroyBuffer(cullOutputBuffer, cullOutputBufferMemory);
+    }
 
-    for(size_t i = 0; i<MAX_FRAMES_IN_FLIGHT; i++){
+    for(size_t i = 0; i<framesInFlight; i++){
         vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-        vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-        vkDestroyFence(device, inFlightFences[i], nullptr);
+    }
+    for(auto semaphore : renderFinishedSemaphores){
+        vkDestroySemaphore(device, semaphore, nullptr);
+    }
+    for(auto semaphore : cullFinishedSemaphores){
+        vkDestroySemaphore(device, semaphore, nullptr);
+    }
+    for(auto fence : inFlightFences){
+        vkDestroyFence(device, fence, nullptr);
+    }
+    if(frameTimeline != VK_NULL_HANDLE){
+        vkDestroySemaphore(device, frameTimeline, nullptr);
+    }
+    for(auto pool : secondaryCommandPools){
+        vkDestroyCommandPool(device, pool, nullptr);
     }
     vkDestroyCommandPool(device, commandPool, nullptr);
+    if(computeCommandPool != VK_NULL_HANDLE){
+        vkDestroyCommandPool(device, computeCommandPool, nullptr);
+    }
+    profiler.destroy();
+    savePipelineCache();
+    vkDestroyPipelineCache(device, pipelineCache, nullptr);
 
+    // What is still allocated here was leaked, only worth printing when memory is being watched
+    if(settings.memoryReportInterval > 0 || settings.profile){
+        memoryAllocator.printReport(std::cout);
+    }
+    memoryAllocator.destroy();
     vkDestroyDevice(device, nullptr);
 
     if(validationLayers.size() != 0){
         DestroyDebugUtilsMessengerEXT(vkInstance, debugMessenger, nullptr);
     }
 
-    vkDestroySurfaceKHR(vkInstance, surface, nullptr);
+    if(!settings.headless){
+        vkDestroySurfaceKHR(vkInstance, surface, nullptr);
+    }
     vkDestroyInstance(vkInstance, nullptr);
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if(!settings.headless){
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
 
 }
 
@@ -1040,71 +2216,137 @@ void AppVulkanCore::cleanupSwapChain()
         vkDestroyFramebuffer(device, framebuffer, nullptr);
     }
 
-    vkFreeCommandBuffers(device, commandPool, commandBuffers.size(), commandBuffers.data());
-
-    vkDestroyPipeline(device, graphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-    vkDestroyRenderPass(device, renderPass, nullptr);
-
     for(auto imageView : swapChainImageViews){
         vkDestroyImageView(device, imageView, nullptr);
     }
 
-    vkDestroySwapchainKHR(device, swapChain, nullptr);
-
-    for(size_t i = 0; i<swapChainImages.size(); i++){
-        vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-        vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
+    if(settings.headless){
+        for(size_t i = 0; i < swapChainImages.size(); i++){
+            vkDestroyImage(device, swapChainImages[i], nullptr);
+            memoryAllocator.free(offscreenImageMemory[i]);
+        }
+        return;
     }
 
-    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroySwapchainKHR(device, swapChain, nullptr);
 }
 
 void AppVulkanCore::drawFrame()
 {
-    vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
-
-    uint32_t imageIndex;
-    VkResult res = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
-    if(res == VK_ERROR_OUT_OF_DATE_KHR){
-        recreateSwapChain();
-        return;
-    } else if(res != VK_SUCCESS && res != VK_SUBOPTIMAL_KHR){
-        throw std::runtime_error("Failed to acquire swap chain image!");
+    profiler.beginFrame();
+    {
+        // Blocks only when the CPU is a full ring of frames ahead of the GPU
+        FrameProfiler::Scope scope(profiler, "wait for frame");
+        waitForFrameValue(frameSubmitValues[currentFrame]);
     }
-
-    if(imagesInFlight[imageIndex] != VK_NULL_HANDLE){
-        vkWaitForFences(device, 1, &imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+    deletionQueue.collect(completedFrameValue());
+    profiler.collectGpu(currentFrame);
+    frameAllocator.beginFrame(currentFrame);
+
+    // Headless frames own the offscreen image of their slot, so there is nothing to acquire
+    uint32_t imageIndex = static_cast<uint32_t>(currentFrame);
+    if(!settings.headless){
+        FrameProfiler::Scope scope(profiler, "acquire");
+        VkResult res = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+        if(res == VK_ERROR_OUT_OF_DATE_KHR){
+            recreateSwapChain();
+            return;
+        } else if(res != VK_SUCCESS && res != VK_SUBOPTIMAL_KHR){
+            throw std::runtime_error("Failed to acquire swap chain image!");
+        }
     }
-    imagesInFlight[imageIndex] = inFlightFences[currentFrame];
 
-    updateUniformBuffer(imageIndex);
+    {
+        FrameProfiler::Scope scope(profiler, "cpu load");
+        simulateCpuLoad();
+    }
+    {
+        FrameProfiler::Scope scope(profiler, "update uniforms");
+        updateUniformBuffers();
+    }
+    if(settings.gpuCulling){
+        // Runs on the compute queue while the frame is recorded, the draw waits for it
+        FrameProfiler::Scope scope(profiler, "submit cull");
+        submitCulling();
+    }
+    {
+        FrameProfiler::Scope scope(profiler, "build queue");
+        buildRenderQueue();
+    }
+    {
+        FrameProfiler::Scope scope(profiler, "record");
+        recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+    }
 
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    VkSemaphore waitForSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
+    VkSemaphore waitForSemaphores[2];
+    VkPipelineStageFlags waitStages[2];
+    uint32_t waitCount = 0;
+    if(!settings.headless){
+        waitForSemaphores[waitCount] = imageAvailableSemaphores[currentFrame];
+        waitStages[waitCount++] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    }
+    if(settings.gpuCulling){
+        waitForSemaphores[waitCount] = cullFinishedSemaphores[currentFrame];
+        waitStages[waitCount++] = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+    }
+    submitInfo.waitSemaphoreCount = waitCount;
     submitInfo.pWaitSemaphores = waitForSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
-
-    VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+
+    uint64_t submitValue = frameTimelineValue + 1;
+    VkSemaphore signalSemaphores[2];
+    uint64_t signalValues[2];
+    uint32_t signalCount = 0;
+    if(!settings.headless){
+        signalSemaphores[signalCount] = renderFinishedSemaphores[imageIndex];
+        signalValues[signalCount++] = 0;
+    }
+    if(timelineSemaphoreSupported){
+        signalSemaphores[signalCount] = frameTimeline;
+        signalValues[signalCount++] = submitValue;
+    }
+    submitInfo.signalSemaphoreCount = signalCount;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    vkResetFences(device, 1, &inFlightFences[currentFrame]);
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = signalCount;
+    timelineInfo.pSignalSemaphoreValues = signalValues;
 
-    if(vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS){
-        throw std::runtime_error("Failed to submit draw command buffer!");
+    VkFence fence = VK_NULL_HANDLE;
+    if(timelineSemaphoreSupported){
+        submitInfo.pNext = &timelineInfo;
+    } else{
+        fence = inFlightFences[currentFrame];
+        vkResetFences(device, 1, &fence);
+    }
+
+    {
+        FrameProfiler::Scope scope(profiler, "submit");
+        if(vkQueueSubmit(graphicsQueue, 1, &submitInfo, fence) != VK_SUCCESS){
+            throw std::runtime_error("Failed to submit draw command buffer!");
+        }
+    }
+    profiler.markSubmit(currentFrame);
+    frameTimelineValue = submitValue;
+    frameSubmitValues[currentFrame] = submitValue;
+    lastImageIndex = imageIndex;
+
+    if(settings.headless){
+        currentFrame++;
+        currentFrame %= framesInFlight;
+        return;
     }
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
+    presentInfo.pWaitSemaphores = &renderFinishedSemaphores[imageIndex];
 
     VkSwapchainKHR swapChains[] = {swapChain};
     presentInfo.swapchainCount = 1;
@@ -1112,7 +2354,22 @@ void AppVulkanCore::drawFrame()
     presentInfo.pImageIndices = &imageIndex;
     presentInfo.pResults = nullptr;
 
-    res = vkQueuePresentKHR(presentQueue, &presentInfo);
+    VkFence presentFence = VK_NULL_HANDLE;
+    VkSwapchainPresentFenceInfoEXT presentFenceInfo{};
+    if(presentFenceSupported){
+        presentFence = acquirePresentFence();
+        presentFenceInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT;
+        presentFenceInfo.swapchainCount = 1;
+        presentFenceInfo.pFences = &presentFence;
+        presentInfo.pNext = &presentFenceInfo;
+        pendingPresents.push_back({swapChain, presentFence});
+    }
+
+    VkResult res;
+    {
+        FrameProfiler::Scope scope(profiler, "present");
+        res = vkQueuePresentKHR(presentQueue, &presentInfo);
+    }
 
     if(res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR || framebufferResized){
         framebufferResized = false;
@@ -1121,13 +2378,11 @@ void AppVulkanCore::drawFrame()
         throw std::runtime_error("Failed to present swap chain image!");
     }
 
-    vkQueueWaitIdle(presentQueue);
-
     currentFrame++;
-    currentFrame %= MAX_FRAMES_IN_FLIGHT;
+    currentFrame %= framesInFlight;
 }
 
-void AppVulkanCore::updateUniformBuffer(uint32_t currentImage)
+void AppVulkanCore::updateUniformBuffers()
 {
     static auto startTime = std::chrono::high_resolution_clock::now();
 
@@ -1139,9 +2394,33 @@ void AppVulkanCore::updateUniformBuffer(uint32_t currentImage)
     ubo.camera = glm::lookAt(glm::vec3(2,2,2), glm::vec3(0, 0, 0), glm::vec3(0, 0, 1));
     ubo.proj = glm::perspective(glm::radians(45.0), swapChainImageExtent.width * 1.0 / swapChainImageExtent.height, 0.1, 10.0);
     ubo.proj[1][1] *= -1;
+    viewMatrix = ubo.camera * ubo.scene;
+
+    if(settings.gpuCulling){
+        // Rows of the clip matrix combine into the clip planes, Vulkan clips depth to [0, w]
+        glm::mat4 clip = ubo.proj * ubo.camera * ubo.scene;
+        glm::vec4 rows[4];
+        for(int row = 0; row < 4; row++){
+            rows[row] = glm::vec4(clip[0][row], clip[1][row], clip[2][row], clip[3][row]);
+        }
+        glm::vec4 planes[6] = {rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[2], rows[3] - rows[2]};
+        for(int i = 0; i < 6; i++){
+            cullConstants.planes[i] = planes[i] / glm::length(glm::vec3(planes[i]));
+        }
+        cullConstants.objectCount = static_cast<uint32_t>(instances.size());
+    }
 
-    void* data;
-    vkMapMemory(device, uniformBuffersMemory[currentImage], 0, sizeof (ubo), 0, &data);
-    memcpy(data, &ubo, sizeof(ubo));
-    vkUnmapMemory(device, uniformBuffersMemory[currentImage]);
+    // One allocation for all objects, then every job fills its own slice of it
+    VkDeviceSize stride = frameAllocator.alignSize(sizeof(UniformBufferObject));
+    uint32_t objectCount = static_cast<uint32_t>(objectTransforms.size());
+    LinearAllocation allocation = frameAllocator.allocate(stride * objectCount);
+
+    jobs.parallelFor(objectCount, 1024, [&](uint32_t begin, uint32_t end){
+        UniformBufferObject objectUbo = ubo;
+        for(uint32_t i = begin; i < end; i++){
+            objectUbo.scene = ubo.scene * objectTransforms[i];
+            memcpy(static_cast<char*>(allocation.data) + stride * i, &objectUbo, sizeof(objectUbo));
+            objectUniformOffsets[i] = static_cast<uint32_t>(allocation.offset + stride * i);
+        }
+    });
 }
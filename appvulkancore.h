@@ -5,54 +5,145 @@
 #include <GLFW/glfw3.h>
 
 #include <vector>
+#include <string>
+#include <optional>
+#include <map>
+#include <deque>
+#include <functional>
 #include "structs.h"
+#include "devicememoryallocator.h"
+#include "framelinearallocator.h"
+#include "uploadmanager.h"
+#include "frameprofiler.h"
+#include "deletionqueue.h"
+#include "jobsystem.h"
+#include "renderqueue.h"
+#include "pipelinemanager.h"
+#include "shaderregistry.h"
+#include "meshfile.h"
+
+struct RunReport{
+    // Requested value clamped to what the renderer supports
+    uint32_t framesInFlight = 0;
+    uint32_t frames = 0;
+    double seconds = 0.0;
+    std::map<std::string, StageTiming> stages;
+    MemoryReport memory;
+    // Totals over all frames
+    RenderQueueStats renderQueue;
+};
 
 class AppVulkanCore
 {
 public:
-    AppVulkanCore(int height, int width);
+    AppVulkanCore(int height, int width, AppSettings settings = AppSettings());
     void run();
+
+    MemoryReport getMemoryReport() const;
+    // Filled when the main loop ends, before any resources are released
+    const RunReport& getRunReport() const;
+
+    // Headless only: copies the last rendered frame to host memory as tightly packed RGBA8
+    std::vector<uint8_t> readbackFrame();
+    void writeFramePpm(const std::string& path);
 private:
-    const int MAX_FRAMES_IN_FLIGHT = 2;
+    static constexpr uint32_t MAX_FRAMES_IN_FLIGHT_LIMIT = 4;
+    static constexpr uint32_t MAX_JOB_THREADS = 16;
+    static constexpr size_t MIN_DRAWS_PER_CHUNK = 256;
+    const VkDeviceSize FRAME_DATA_REGION_SIZE = 4 * 1024 * 1024;
+    const VkDeviceSize UPLOAD_RING_SIZE = 16 * 1024 * 1024;
 
     int height;
     int width;
-    GLFWwindow* window;
+    AppSettings settings;
+    uint32_t framesInFlight;
+    JobSystem jobs;
+    GLFWwindow* window = nullptr;
     VkInstance vkInstance;
     std::vector<const char*> validationLayers;
     std::vector<const char*> deviceExtensions;
+    bool memoryBudgetSupported = false;
+    // VK_EXT_swapchain_maintenance1 present fences, its instance side needs VK_EXT_surface_maintenance1
+    bool surfaceMaintenanceSupported = false;
+    bool presentFenceSupported = false;
     std::vector<VkImage> swapChainImages;
     std::vector<VkImageView> swapChainImageViews;
     std::vector<VkFramebuffer> swapChainFramebuffers;
     std::vector<VkCommandBuffer> commandBuffers;
-    std::vector<VkDescriptorSet> descriptorSets;
+    // One secondary command buffer chunk per job thread
+    uint32_t recordThreadCount;
+    // Indexed by frame slot * recordThreadCount + chunk
+    std::vector<VkCommandPool> secondaryCommandPools;
+    std::vector<VkCommandBuffer> secondaryCommandBuffers;
     VkDebugUtilsMessengerEXT debugMessenger;
     VkPhysicalDevice physicalDevice;
     VkDevice device;
     VkQueue graphicsQueue;
     VkQueue presentQueue;
-    VkSurfaceKHR surface;
-    VkSwapchainKHR swapChain;
+    VkQueue transferQueue;
+    VkQueue computeQueue;
+    // Equal when the device has no compute-only family, buffers then need no ownership transfers
+    uint32_t graphicsQueueFamily = 0;
+    uint32_t computeQueueFamily = 0;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+    // Headless targets stand in for the swapchain images, one per frame in flight
+    std::vector<MemoryAllocation> offscreenImageMemory;
+    uint32_t lastImageIndex = 0;
     VkFormat swapChainImageFormat;
     VkExtent2D swapChainImageExtent;
     VkRenderPass renderPass;
     VkDescriptorSetLayout descriptorSetLayout;
     VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
     VkPipelineLayout pipelineLayout;
-    VkPipeline graphicsPipeline;
+    ShaderRegistry shaderRegistry;
+    PipelineManager pipelineManager;
+    // Compiled before the first frame, stands in for variants that are still compiling
+    PipelineHandle defaultPipeline;
+    PipelineHandle scenePipeline;
+    bool fillModeNonSolidSupported = false;
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    VkDescriptorSetLayout cullDescriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSet cullDescriptorSet;
+    VkPipelineLayout cullPipelineLayout;
+    VkPipeline cullPipeline = VK_NULL_HANDLE;
     VkCommandPool commandPool;
+    // Records the work submitted on computeQueue, only created for GPU culling
+    VkCommandPool computeCommandPool = VK_NULL_HANDLE;
+    DeviceMemoryAllocator memoryAllocator;
+    UploadManager uploadManager;
+    FrameProfiler profiler;
+    DeletionQueue deletionQueue;
+    VkBuffer uploadRingBuffer;
+    MemoryAllocation uploadRingBufferMemory;
 
     std::vector<VkSemaphore> imageAvailableSemaphores;
+    // One per swapchain image: the present waiting on it is only known to be done once that image
+    // is acquired again, which a frame slot cannot tell
     std::vector<VkSemaphore> renderFinishedSemaphores;
+    // Used only when the device lacks timeline semaphores
     std::vector<VkFence> inFlightFences;
-    std::vector<VkFence> imagesInFlight;
+    bool timelineSemaphoreSupported = false;
+    // Every graphics submission signals the next value, a frame slot is free once its value completed
+    VkSemaphore frameTimeline = VK_NULL_HANDLE;
+    uint64_t frameTimelineValue = 0;
+    std::vector<uint64_t> frameSubmitValues;
     size_t currentFrame = 0;
+    // Present fences only: each signals once its present no longer uses the semaphore or the swapchain
+    struct PendingPresent{
+        VkSwapchainKHR swapChain;
+        VkFence fence;
+    };
+    std::deque<PendingPresent> pendingPresents;
+    std::vector<VkFence> freePresentFences;
 
     bool framebufferResized = false;
 
     bool checkValidationLayerSupport();
     bool isDevicesSuitable(VkPhysicalDevice device);
     bool checkDeviceExtensionsSupport(VkPhysicalDevice device);
+    bool checkDeviceExtensionSupport(VkPhysicalDevice device, const char* extension);
     std::vector<const char*> getRequiredExtensions();    
 
     static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
@@ -74,13 +165,15 @@ private:
     VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
 
     std::vector<char> readFile(const std::string& filename);
-    VkShaderModule createShaderModule(const std::vector<char>& code);
 
     uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+    std::optional<uint32_t> findDirectWriteMemoryType(uint32_t typeFilter);
 
-    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-
-    void copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size);
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, MemoryAllocation& bufferMemory, MemoryCategory category);
+    // chooseMemoryType gets the buffer's allowed memory type bits and returns the type to allocate from
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, const std::function<uint32_t(uint32_t)>& chooseMemoryType, VkBuffer& buffer, MemoryAllocation& bufferMemory, MemoryCategory category);
+    void createStaticBuffer(const char* name, const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, MemoryAllocation& bufferMemory, MemoryCategory category);
+    void destroyBuffer(VkBuffer buffer, MemoryAllocation& bufferMemory);
 
     void initWindow();
     void initVulkan();
@@ -88,39 +181,99 @@ private:
     void createSurface();
     void pickPhysicalDevice();
     void createLogicalDevice();
+    void createMemoryAllocator();
+    void createPipelineCache();
+    void savePipelineCache();
     void createSwapChain();
+    void createOffscreenTargets();
     void createImageViews();
     void createRenderPass();
     void createDescriptorSetLayout();
     void createGraphicsPipeline();
     void createFramebuffer();
     void createCommandPool();
+    void createUploadManager();
     void createVertexBuffers();
     void createIndexBuffers();
-    void createUniformBuffers();
+    void createFrameDataBuffer();
     void createDescriptorPool();
     void createDescriprorSets();
+    void createCullBuffers();
+    void createCullPipeline();
+    void createCullCommandBuffers();
+    VkBufferMemoryBarrier cullOutputOwnershipBarrier() const;
+    void submitCulling();
     void createCommandBuffers();
+    void buildRenderQueue();
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    RenderQueueStats recordSecondaryCommandBuffer(uint32_t chunk, uint32_t imageIndex, size_t first, size_t count);
+    RenderQueueStats recordDraws(VkCommandBuffer commandBuffer, size_t first, size_t count);
     void createSyncObjects();
+    void createRenderFinishedSemaphores();
+    void createProfiler();
+    void finishProfiling();
+    uint64_t completedFrameValue();
+    void waitForFrameValue(uint64_t value);
     void createInstance();
     void recreateSwapChain();
+    VkFence acquirePresentFence();
     void mainLoop();
+    void reportMemory();
+    void simulateCpuLoad();
     void cleanup();
     void cleanupSwapChain();
 
     void drawFrame();
-    void updateUniformBuffer(uint32_t currentImage);
+    void updateUniformBuffers();
+    void buildSyntheticScene();
+    void buildGridMesh();
+    void optimizeSceneMesh();
 
 
-    // Draw data
+    // Draw data. The mesh points into meshFile when one is loaded, otherwise into the generated grid below.
+    Mesh mesh;
+    MappedFile meshFile;
     std::vector<Vertex> vertices;
-    std::vector<uint16_t> indices;
+    std::vector<uint16_t> indices16;
+    std::vector<uint32_t> indices32;
+    // Compact vertex formats only: the grid converted once
+    std::vector<Snorm16Vertex> snorm16Vertices;
+    std::vector<HalfVertex> halfVertices;
+    // --optimize-mesh only: the reordered copy of whichever data the mesh pointed at
+    std::vector<char> optimizedVertices;
+    std::vector<char> optimizedIndices;
     VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
+    MemoryAllocation vertexBufferMemory;
     VkBuffer indexBuffer;
-    VkDeviceMemory indexBufferMemory;
-    std::vector<VkBuffer> uniformBuffers;
-    std::vector<VkDeviceMemory> uniformBuffersMemory;
+    MemoryAllocation indexBufferMemory;
+    // Instanced mode only: one entry per object, drawn with a single vkCmdDrawIndexed
+    std::vector<InstanceData> instances;
+    VkBuffer instanceBuffer = VK_NULL_HANDLE;
+    MemoryAllocation instanceBufferMemory;
+    // GPU culling only: a bounding sphere per instance, and per frame slot an indirect command followed by the visible instances
+    std::vector<glm::vec4> instanceBounds;
+    VkBuffer boundsBuffer;
+    MemoryAllocation boundsBufferMemory;
+    VkBuffer cullOutputBuffer;
+    MemoryAllocation cullOutputBufferMemory;
+    VkDeviceSize cullRegionSize;
+    VkDeviceSize cullVisibleOffset;
+    CullPushConstants cullConstants;
+    // Culling runs on computeQueue, the graphics submit of the same frame slot waits on its semaphore
+    std::vector<VkCommandBuffer> computeCommandBuffers;
+    std::vector<VkSemaphore> cullFinishedSemaphores;
+    VkBuffer frameDataBuffer;
+    MemoryAllocation frameDataBufferMemory;
+    VkDeviceSize frameDataRegionSize;
+    FrameLinearAllocator frameAllocator;
+    std::vector<glm::mat4> objectTransforms;
+    // Dynamic uniform offset of every object for the frame being recorded
+    std::vector<uint32_t> objectUniformOffsets;
+    // camera * scene of the frame being recorded, used for depth sorting
+    glm::mat4 viewMatrix;
+    RenderQueue renderQueue;
+    RenderQueueStats renderQueueStats;
+    RunReport runReport;
 };
 
 #endif // APPVULKANCORE_H
@@ -0,0 +1,90 @@
+#include "atomicfile.h"
+#include <stdexcept>
+#include <algorithm>
+#include <filesystem>
+
+#ifdef _WIN32
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#ifdef _WIN32
+static bool writeAndSync(const std::string& path, const std::vector<FileChunk>& chunks)
+{
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE) return false;
+
+    bool written = true;
+    for(const FileChunk& chunk : chunks){
+        const char* data = static_cast<const char*>(chunk.data);
+        size_t remaining = chunk.size;
+        while(written && remaining != 0){
+            DWORD count = static_cast<DWORD>(std::min<size_t>(remaining, 1u << 30));
+            DWORD done = 0;
+            written = WriteFile(file, data, count, &done, nullptr) && done != 0;
+            data += done;
+            remaining -= done;
+        }
+    }
+    written = written && FlushFileBuffers(file);
+    return CloseHandle(file) && written;
+}
+#else
+static bool writeAndSync(const std::string& path, const std::vector<FileChunk>& chunks)
+{
+    int descriptor = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(descriptor < 0) return false;
+
+    bool written = true;
+    for(const FileChunk& chunk : chunks){
+        const char* data = static_cast<const char*>(chunk.data);
+        size_t remaining = chunk.size;
+        while(written && remaining != 0){
+            ssize_t done = ::write(descriptor, data, remaining);
+            if(done < 0 && errno == EINTR) continue;
+            written = done > 0;
+            if(written){
+                data += done;
+                remaining -= static_cast<size_t>(done);
+            }
+        }
+    }
+    // Without this the rename can reach the disk before the data does
+    written = written && fsync(descriptor) == 0;
+    return ::close(descriptor) == 0 && written;
+}
+
+// Makes the rename itself durable, best effort since not every file system allows it
+static void syncDirectory(const std::filesystem::path& path)
+{
+    std::filesystem::path directory = path.parent_path();
+    int descriptor = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_CLOEXEC);
+    if(descriptor < 0) return;
+    fsync(descriptor);
+    ::close(descriptor);
+}
+#endif
+
+void writeFileAtomically(const std::string &path, const std::vector<FileChunk> &chunks)
+{
+    std::string tempPath = path + ".tmp";
+    std::error_code error;
+    if(!writeAndSync(tempPath, chunks)){
+        std::filesystem::remove(tempPath, error);
+        throw std::runtime_error("Failed to write " + tempPath);
+    }
+
+    std::filesystem::rename(tempPath, path, error);
+    if(error){
+        std::string message = error.message();
+        std::filesystem::remove(tempPath, error);
+        throw std::runtime_error("Failed to replace " + path + ": " + message);
+    }
+#ifndef _WIN32
+    syncDirectory(path);
+#endif
+}
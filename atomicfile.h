@@ -0,0 +1,18 @@
+#ifndef ATOMICFILE_H
+#define ATOMICFILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct FileChunk{
+    const void* data;
+    size_t size;
+};
+
+// Writes the chunks in order to path + ".tmp", flushes it to disk and renames it over path, so a
+// crash or power loss leaves either the old file or the complete new one. Throws on failure and
+// removes the temp file.
+void writeFileAtomically(const std::string& path, const std::vector<FileChunk>& chunks);
+
+#endif // ATOMICFILE_H
@@ -0,0 +1,178 @@
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "appvulkancore.h"
+#include "vertexquantizer.h"
+
+// Runs AppVulkanCore over every combination of the requested scene sizes and frames in flight
+// and writes one JSON report. Headless by default so it also runs on software drivers (lavapipe, SwiftShader).
+
+struct BenchOptions{
+    bool headless = true;
+    bool instanced = false;
+    bool gpuCulling = false;
+    VertexFormat vertexFormat = VertexFormat::Float;
+    uint32_t frames = 500;
+    int width = 800;
+    int height = 600;
+    std::vector<uint32_t> objectCounts = {1, 100, 1000};
+    std::vector<uint32_t> triangleCounts = {2, 2000};
+    std::vector<uint32_t> framesInFlight = {1, 2, 3};
+    std::string outputPath = "bench.json";
+    // Off unless asked for, a cache shared between runs would make every run after the first warm
+    std::string pipelineCachePath;
+};
+
+static std::vector<uint32_t> parseList(const char* text){
+    std::vector<uint32_t> values;
+    std::string list(text);
+    size_t begin = 0;
+    while(begin <= list.size()){
+        size_t end = list.find(',', begin);
+        if(end == std::string::npos) end = list.size();
+        values.push_back(static_cast<uint32_t>(std::stoul(list.substr(begin, end - begin))));
+        begin = end + 1;
+    }
+    return values;
+}
+
+static BenchOptions parseArguments(int argc, char** argv){
+    BenchOptions options;
+    for(int i = 1; i < argc; i++){
+        bool hasValue = i + 1 < argc;
+        if(strcmp(argv[i], "--windowed") == 0){
+            options.headless = false;
+        }
+        else if(strcmp(argv[i], "--instanced") == 0){
+            options.instanced = true;
+        }
+        else if(strcmp(argv[i], "--gpu-culling") == 0){
+            options.gpuCulling = true;
+        }
+        else if(strcmp(argv[i], "--vertex-format") == 0 && hasValue){
+            options.vertexFormat = parseVertexFormat(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--frames") == 0 && hasValue){
+            options.frames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if(strcmp(argv[i], "--size") == 0 && hasValue){
+            if(sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 || options.height <= 0){
+                throw std::runtime_error("Size must be given as <width>x<height>");
+            }
+        }
+        else if(strcmp(argv[i], "--objects") == 0 && hasValue){
+            options.objectCounts = parseList(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--triangles") == 0 && hasValue){
+            options.triangleCounts = parseList(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--frames-in-flight") == 0 && hasValue){
+            options.framesInFlight = parseList(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--output") == 0 && hasValue){
+            options.outputPath = argv[++i];
+        }
+        else if(strcmp(argv[i], "--pipeline-cache") == 0 && hasValue){
+            options.pipelineCachePath = argv[++i];
+        }
+        else if(strcmp(argv[i], "--no-pipeline-cache") == 0){
+            options.pipelineCachePath.clear();
+        }
+        else{
+            throw std::runtime_error(std::string("Unknown or incomplete argument: ") + argv[i]);
+        }
+    }
+    return options;
+}
+
+static void writeRun(std::ostream& out, const AppSettings& settings, const RunReport& report){
+    out << "{\"objects\":" << settings.objectCount
+        << ",\"trianglesPerObject\":" << settings.trianglesPerObject
+        << ",\"framesInFlight\":" << report.framesInFlight
+        << ",\"headless\":" << (settings.headless ? "true" : "false")
+        << ",\"instanced\":" << (settings.instanced || settings.gpuCulling ? "true" : "false")
+        << ",\"gpuCulling\":" << (settings.gpuCulling ? "true" : "false")
+        << ",\"vertexFormat\":\"" << vertexFormatName(settings.vertexFormat) << "\""
+        << ",\"frames\":" << report.frames
+        << ",\"seconds\":" << report.seconds
+        << ",\"fps\":" << (report.seconds > 0 ? report.frames / report.seconds : 0.0)
+        << ",\"stages\":{";
+
+    bool first = true;
+    for(const auto& [name, timing] : report.stages){
+        if(!first) out << ",";
+        first = false;
+        out << "\"" << name << "\":{\"samples\":" << timing.samples << ",\"mean\":" << timing.mean
+            << ",\"p50\":" << timing.p50 << ",\"p95\":" << timing.p95 << ",\"p99\":" << timing.p99 << "}";
+    }
+
+    const MemoryReport& memory = report.memory;
+    out << "},\"memory\":{\"reservedBytes\":" << memory.stats.blockBytes
+        << ",\"usedBytes\":" << memory.stats.usedBytes
+        << ",\"allocations\":" << memory.stats.allocationCount
+        << ",\"categories\":{";
+    for(size_t i = 0; i < memory.categoryBytes.size(); i++){
+        if(i != 0) out << ",";
+        out << "\"" << memoryCategoryName(static_cast<MemoryCategory>(i)) << "\":" << memory.categoryBytes[i];
+    }
+
+    const RenderQueueStats& queue = report.renderQueue;
+    out << "}},\"renderQueue\":{\"draws\":" << queue.draws
+        << ",\"pipelineBinds\":" << queue.pipelineBinds
+        << ",\"descriptorBinds\":" << queue.descriptorBinds
+        << ",\"vertexBufferBinds\":" << queue.vertexBufferBinds
+        << ",\"indexBufferBinds\":" << queue.indexBufferBinds
+        << ",\"bindsSkipped\":" << queue.bindsSkipped << "}}";
+}
+
+int main(int argc, char** argv){
+    try {
+        BenchOptions options = parseArguments(argc, argv);
+
+        std::ofstream file(options.outputPath);
+        if(!file.is_open()){
+            throw std::runtime_error("Failed to open benchmark output file!");
+        }
+        file << "{\"runs\":[" << std::endl;
+
+        bool first = true;
+        for(uint32_t objects : options.objectCounts){
+            for(uint32_t triangles : options.triangleCounts){
+                for(uint32_t inFlight : options.framesInFlight){
+                    AppSettings settings;
+                    settings.headless = options.headless;
+                    settings.instanced = options.instanced;
+                    settings.gpuCulling = options.gpuCulling;
+                    settings.vertexFormat = options.vertexFormat;
+                    settings.benchmarkFrames = options.frames;
+                    settings.objectCount = objects;
+                    settings.trianglesPerObject = triangles;
+                    settings.framesInFlight = inFlight;
+                    settings.pipelineCachePath = options.pipelineCachePath;
+
+                    std::cout << "Bench: " << objects << " objects, " << triangles << " triangles, "
+                              << inFlight << " frames in flight" << std::endl;
+                    AppVulkanCore app(options.height, options.width, settings);
+                    app.run();
+
+                    if(!first) file << "," << std::endl;
+                    first = false;
+                    writeRun(file, settings, app.getRunReport());
+                }
+            }
+        }
+        file << std::endl << "]}" << std::endl;
+        std::cout << "Benchmark report written to " << options.outputPath << std::endl;
+    }  catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
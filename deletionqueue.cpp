@@ -0,0 +1,27 @@
+#include "deletionqueue.h"
+
+void DeletionQueue::push(uint64_t retireValue, std::function<void()> destroy)
+{
+    entries.push_back({retireValue, std::move(destroy)});
+}
+
+void DeletionQueue::collect(uint64_t completedValue)
+{
+    while(!entries.empty() && entries.front().retireValue <= completedValue){
+        entries.front().destroy();
+        entries.pop_front();
+    }
+}
+
+void DeletionQueue::flush()
+{
+    for(auto& entry : entries){
+        entry.destroy();
+    }
+    entries.clear();
+}
+
+size_t DeletionQueue::size() const
+{
+    return entries.size();
+}
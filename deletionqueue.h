@@ -0,0 +1,30 @@
+#ifndef DELETIONQUEUE_H
+#define DELETIONQUEUE_H
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+// Destroys GPU objects once the frame timeline passes the value they were retired at,
+// i.e. once every submission that could still reference them has completed.
+class DeletionQueue
+{
+public:
+    void push(uint64_t retireValue, std::function<void()> destroy);
+    void collect(uint64_t completedValue);
+    // Destroys everything regardless of value, the device must be idle
+    void flush();
+
+    size_t size() const;
+
+private:
+    struct Entry{
+        uint64_t retireValue;
+        std::function<void()> destroy;
+    };
+
+    // Values are pushed in non-decreasing order, so collection only looks at the front
+    std::deque<Entry> entries;
+};
+
+#endif // DELETIONQUEUE_H
@@ -0,0 +1,345 @@
+#include "devicememoryallocator.h"
+#include <stdexcept>
+#include <algorithm>
+#include <iterator>
+
+const char *memoryCategoryName(MemoryCategory category)
+{
+    switch(category){
+    case MemoryCategory::Vertex: return "vertex";
+    case MemoryCategory::Index: return "index";
+    case MemoryCategory::Uniform: return "uniform";
+    case MemoryCategory::Staging: return "staging";
+    case MemoryCategory::Image: return "image";
+    default: return "other";
+    }
+}
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void DeviceMemoryAllocator::init(VkPhysicalDevice physicalDevice, VkDevice device, bool memoryBudget, VkDeviceSize blockSize)
+{
+    this->physicalDevice = physicalDevice;
+    this->device = device;
+    this->memoryBudget = memoryBudget;
+    preferredBlockSize = blockSize;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    bufferImageGranularity = std::max<VkDeviceSize>(properties.limits.bufferImageGranularity, 1);
+    maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+}
+
+void DeviceMemoryAllocator::destroy()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for(auto& [key, blocks] : pools){
+        for(auto& block : blocks){
+            if(block->mapped != nullptr){
+                vkUnmapMemory(device, block->memory);
+            }
+            vkFreeMemory(device, block->memory, nullptr);
+        }
+    }
+    pools.clear();
+}
+
+MemoryAllocation DeviceMemoryAllocator::allocate(const VkMemoryRequirements &requirements, uint32_t memoryType, bool linear, MemoryCategory category)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    MemoryAllocation allocation{};
+    allocation.category = category;
+    uint32_t key = poolKey(memoryType, linear);
+    VkDeviceSize blockSize = blockSizeFor(memoryType);
+
+    if(requirements.size > blockSize / 2){
+        MemoryBlock* block = createBlock(key, memoryType, requirements.size, true);
+        allocateFromBlock(*block, requirements, allocation);
+        return allocation;
+    }
+
+    for(auto& block : pools[key]){
+        if(!block->dedicated && allocateFromBlock(*block, requirements, allocation)){
+            return allocation;
+        }
+    }
+
+    MemoryBlock* block = createBlock(key, memoryType, blockSize, false);
+    if(!allocateFromBlock(*block, requirements, allocation)){
+        throw std::runtime_error("Failed to sub-allocate from a fresh memory block!");
+    }
+    return allocation;
+}
+
+void DeviceMemoryAllocator::free(MemoryAllocation &allocation)
+{
+    if(allocation.block == nullptr) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    MemoryBlock* block = allocation.block;
+
+    VkDeviceSize start = allocation.rangeOffset;
+    VkDeviceSize size = allocation.rangeSize;
+    auto next = block->freeRanges.lower_bound(start);
+    if(next != block->freeRanges.end() && start + size == next->first){
+        size += next->second;
+        next = block->freeRanges.erase(next);
+    }
+    if(next != block->freeRanges.begin()){
+        auto prev = std::prev(next);
+        if(prev->first + prev->second == start){
+            start = prev->first;
+            size += prev->second;
+            block->freeRanges.erase(prev);
+        }
+    }
+    block->freeRanges[start] = size;
+
+    block->allocationCount--;
+    block->usedBytes -= allocation.size;
+    block->paddingBytes -= allocation.rangeSize - allocation.size;
+    categoryBytes[static_cast<size_t>(allocation.category)] -= allocation.size;
+    allocation = MemoryAllocation{};
+
+    if(block->allocationCount == 0){
+        // Keep one empty block per pool around so alloc/free churn does not hit the driver
+        bool spareExists = false;
+        for(auto& other : pools[block->pool]){
+            if(other.get() != block && !other->dedicated && other->allocationCount == 0){
+                spareExists = true;
+                break;
+            }
+        }
+        if(block->dedicated || spareExists){
+            destroyBlock(block);
+        }
+    }
+}
+
+MemoryAllocatorStats DeviceMemoryAllocator::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    MemoryAllocatorStats stats{};
+    for(const auto& [key, blocks] : pools){
+        for(const auto& block : blocks){
+            stats.blockCount++;
+            if(block->dedicated) stats.dedicatedBlockCount++;
+            stats.allocationCount += block->allocationCount;
+            stats.blockBytes += block->size;
+            stats.usedBytes += block->usedBytes;
+            stats.paddingBytes += block->paddingBytes;
+        }
+    }
+    return stats;
+}
+
+void DeviceMemoryAllocator::printStats(std::ostream &out) const
+{
+    MemoryAllocatorStats stats = getStats();
+    out << "Device memory: " << stats.blockCount << " blocks (" << stats.dedicatedBlockCount << " dedicated), "
+        << stats.allocationCount << " allocations, "
+        << stats.blockBytes << " B reserved, "
+        << stats.usedBytes << " B used, "
+        << stats.paddingBytes << " B padding, "
+        << stats.freeBytes() << " B free" << std::endl;
+}
+
+MemoryReport DeviceMemoryAllocator::getReport() const
+{
+    MemoryReport report{};
+    report.stats = getStats();
+    report.heaps.resize(memProperties.memoryHeapCount);
+    for(uint32_t i = 0; i < memProperties.memoryHeapCount; i++){
+        report.heaps[i].size = memProperties.memoryHeaps[i].size;
+        report.heaps[i].deviceLocal = memProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        report.categoryBytes = categoryBytes;
+        for(const auto& [key, blocks] : pools){
+            for(const auto& block : blocks){
+                MemoryHeapReport& heap = report.heaps[memProperties.memoryTypes[block->memoryType].heapIndex];
+                heap.blockBytes += block->size;
+                heap.usedBytes += block->usedBytes;
+            }
+        }
+    }
+
+    if(memoryBudget){
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        VkPhysicalDeviceMemoryProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        properties2.pNext = &budgetProperties;
+        vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties2);
+
+        report.budgetAvailable = true;
+        for(uint32_t i = 0; i < report.heaps.size(); i++){
+            report.heaps[i].budget = budgetProperties.heapBudget[i];
+            report.heaps[i].processUsage = budgetProperties.heapUsage[i];
+        }
+    }
+
+    return report;
+}
+
+void DeviceMemoryAllocator::printReport(std::ostream &out) const
+{
+    MemoryReport report = getReport();
+    printStats(out);
+    for(uint32_t i = 0; i < report.heaps.size(); i++){
+        const MemoryHeapReport& heap = report.heaps[i];
+        out << "  heap " << i << (heap.deviceLocal ? " (device local)" : "") << ": "
+            << heap.blockBytes << " B reserved, " << heap.usedBytes << " B used of " << heap.size << " B";
+        if(report.budgetAvailable){
+            out << ", process usage " << heap.processUsage << " B, budget " << heap.budget << " B";
+            if(heap.processUsage > heap.budget / 10 * 9){
+                out << " WARNING: above 90% of budget";
+            }
+        }
+        out << std::endl;
+    }
+    out << "  categories:";
+    for(size_t i = 0; i < report.categoryBytes.size(); i++){
+        out << " " << memoryCategoryName(static_cast<MemoryCategory>(i)) << " " << report.categoryBytes[i] << " B";
+    }
+    out << std::endl;
+}
+
+void DeviceMemoryAllocator::writeReportJson(std::ostream &out) const
+{
+    MemoryReport report = getReport();
+    out << "{\"blocks\":" << report.stats.blockCount
+        << ",\"dedicatedBlocks\":" << report.stats.dedicatedBlockCount
+        << ",\"allocations\":" << report.stats.allocationCount
+        << ",\"reservedBytes\":" << report.stats.blockBytes
+        << ",\"usedBytes\":" << report.stats.usedBytes
+        << ",\"paddingBytes\":" << report.stats.paddingBytes
+        << ",\"budgetAvailable\":" << (report.budgetAvailable ? "true" : "false")
+        << ",\"heaps\":[";
+    for(uint32_t i = 0; i < report.heaps.size(); i++){
+        const MemoryHeapReport& heap = report.heaps[i];
+        if(i != 0) out << ",";
+        out << "{\"size\":" << heap.size
+            << ",\"deviceLocal\":" << (heap.deviceLocal ? "true" : "false")
+            << ",\"reservedBytes\":" << heap.blockBytes
+            << ",\"usedBytes\":" << heap.usedBytes
+            << ",\"budget\":" << heap.budget
+            << ",\"processUsage\":" << heap.processUsage << "}";
+    }
+    out << "],\"categories\":{";
+    for(size_t i = 0; i < report.categoryBytes.size(); i++){
+        if(i != 0) out << ",";
+        out << "\"" << memoryCategoryName(static_cast<MemoryCategory>(i)) << "\":" << report.categoryBytes[i];
+    }
+    out << "}}";
+}
+
+uint32_t DeviceMemoryAllocator::poolKey(uint32_t memoryType, bool linear) const
+{
+    // Linear and optimal resources only need separate blocks when the device
+    // reports a granularity, otherwise they can share pages freely
+    if(bufferImageGranularity <= 1) return memoryType;
+    return memoryType * 2 + (linear ? 0 : 1);
+}
+
+VkDeviceSize DeviceMemoryAllocator::blockSizeFor(uint32_t memoryType) const
+{
+    VkDeviceSize heapSize = memProperties.memoryHeaps[memProperties.memoryTypes[memoryType].heapIndex].size;
+    return std::min(preferredBlockSize, heapSize / 8);
+}
+
+MemoryBlock *DeviceMemoryAllocator::createBlock(uint32_t pool, uint32_t memoryType, VkDeviceSize size, bool dedicated)
+{
+    if(maxAllocationCount != 0 && totalBlockCount() >= maxAllocationCount){
+        throw std::runtime_error("Reached maxMemoryAllocationCount!");
+    }
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+
+    auto block = std::make_unique<MemoryBlock>();
+    if(vkAllocateMemory(device, &allocInfo, nullptr, &block->memory) != VK_SUCCESS){
+        throw std::runtime_error("Failed to allocate device memory block!");
+    }
+
+    if(memProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT){
+        if(vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS){
+            vkFreeMemory(device, block->memory, nullptr);
+            throw std::runtime_error("Failed to map device memory block!");
+        }
+    }
+
+    block->size = size;
+    block->memoryType = memoryType;
+    block->dedicated = dedicated;
+    block->pool = pool;
+    block->freeRanges[0] = size;
+
+    MemoryBlock* result = block.get();
+    pools[pool].push_back(std::move(block));
+    return result;
+}
+
+void DeviceMemoryAllocator::destroyBlock(MemoryBlock *block)
+{
+    auto& blocks = pools[block->pool];
+    auto it = std::find_if(blocks.begin(), blocks.end(), [block](const auto& b){ return b.get() == block; });
+    if(it == blocks.end()) return;
+
+    if(block->mapped != nullptr){
+        vkUnmapMemory(device, block->memory);
+    }
+    vkFreeMemory(device, block->memory, nullptr);
+    blocks.erase(it);
+}
+
+bool DeviceMemoryAllocator::allocateFromBlock(MemoryBlock &block, const VkMemoryRequirements &requirements, MemoryAllocation &allocation)
+{
+    VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+    for(auto it = block.freeRanges.begin(); it != block.freeRanges.end(); it++){
+        VkDeviceSize rangeStart = it->first;
+        VkDeviceSize rangeEnd = it->first + it->second;
+        VkDeviceSize offset = alignUp(rangeStart, alignment);
+        if(offset + requirements.size > rangeEnd) continue;
+
+        VkDeviceSize used = offset + requirements.size - rangeStart;
+        block.freeRanges.erase(it);
+        if(rangeStart + used < rangeEnd){
+            block.freeRanges[rangeStart + used] = rangeEnd - rangeStart - used;
+        }
+
+        block.allocationCount++;
+        block.usedBytes += requirements.size;
+        block.paddingBytes += used - requirements.size;
+        categoryBytes[static_cast<size_t>(allocation.category)] += requirements.size;
+
+        allocation.memory = block.memory;
+        allocation.offset = offset;
+        allocation.size = requirements.size;
+        allocation.mapped = block.mapped != nullptr ? static_cast<char*>(block.mapped) + offset : nullptr;
+        allocation.memoryType = block.memoryType;
+        allocation.block = &block;
+        allocation.rangeOffset = rangeStart;
+        allocation.rangeSize = used;
+        return true;
+    }
+    return false;
+}
+
+uint32_t DeviceMemoryAllocator::totalBlockCount() const
+{
+    uint32_t count = 0;
+    for(const auto& [key, blocks] : pools){
+        count += blocks.size();
+    }
+    return count;
+}
@@ -0,0 +1,135 @@
+#ifndef DEVICEMEMORYALLOCATOR_H
+#define DEVICEMEMORYALLOCATOR_H
+
+#ifndef GLFW_INCLUDE_VULKAN
+    #define GLFW_INCLUDE_VULKAN
+    #include <GLFW/glfw3.h>
+#endif
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+enum class MemoryCategory{
+    Vertex,
+    Index,
+    Uniform,
+    Staging,
+    Image,
+    Other,
+    Count
+};
+
+const char* memoryCategoryName(MemoryCategory category);
+
+struct MemoryBlock{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    void* mapped = nullptr;
+    uint32_t memoryType = 0;
+    uint32_t pool = 0;
+    bool dedicated = false;
+
+    // offset -> size of every free range, kept coalesced
+    std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+    uint32_t allocationCount = 0;
+    VkDeviceSize usedBytes = 0;
+    VkDeviceSize paddingBytes = 0;
+};
+
+struct MemoryAllocation{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void* mapped = nullptr;
+    uint32_t memoryType = 0;
+    MemoryCategory category = MemoryCategory::Other;
+
+    // Range reserved inside the block, including alignment padding
+    MemoryBlock* block = nullptr;
+    VkDeviceSize rangeOffset = 0;
+    VkDeviceSize rangeSize = 0;
+};
+
+struct MemoryAllocatorStats{
+    uint32_t blockCount = 0;
+    uint32_t dedicatedBlockCount = 0;
+    uint32_t allocationCount = 0;
+    VkDeviceSize blockBytes = 0;
+    VkDeviceSize usedBytes = 0;
+    VkDeviceSize paddingBytes = 0;
+
+    VkDeviceSize freeBytes() const{
+        return blockBytes - usedBytes - paddingBytes;
+    }
+
+    VkDeviceSize wastedBytes() const{
+        return blockBytes - usedBytes;
+    }
+};
+
+struct MemoryHeapReport{
+    VkDeviceSize size = 0;
+    bool deviceLocal = false;
+    VkDeviceSize blockBytes = 0;
+    VkDeviceSize usedBytes = 0;
+    // Filled from VK_EXT_memory_budget, zero when the extension is not enabled
+    VkDeviceSize budget = 0;
+    VkDeviceSize processUsage = 0;
+};
+
+struct MemoryReport{
+    MemoryAllocatorStats stats;
+    bool budgetAvailable = false;
+    std::vector<MemoryHeapReport> heaps;
+    std::array<VkDeviceSize, static_cast<size_t>(MemoryCategory::Count)> categoryBytes{};
+};
+
+// Carves resources out of large VkDeviceMemory blocks, one pool per memory type.
+// Host visible blocks are mapped once for their whole lifetime.
+class DeviceMemoryAllocator
+{
+public:
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, bool memoryBudget, VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+    void destroy();
+
+    // linear is true for buffers and linear images, false for optimal tiling images
+    MemoryAllocation allocate(const VkMemoryRequirements& requirements, uint32_t memoryType, bool linear, MemoryCategory category = MemoryCategory::Other);
+    void free(MemoryAllocation& allocation);
+
+    MemoryAllocatorStats getStats() const;
+    void printStats(std::ostream& out) const;
+
+    MemoryReport getReport() const;
+    void printReport(std::ostream& out) const;
+    void writeReportJson(std::ostream& out) const;
+
+private:
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkDevice device = VK_NULL_HANDLE;
+    bool memoryBudget = false;
+    VkPhysicalDeviceMemoryProperties memProperties{};
+    VkDeviceSize bufferImageGranularity = 1;
+    uint32_t maxAllocationCount = 0;
+    VkDeviceSize preferredBlockSize = DEFAULT_BLOCK_SIZE;
+
+    mutable std::mutex mutex;
+    // Blocks bucketed by memory type and, when bufferImageGranularity forces it, by resource tiling
+    std::map<uint32_t, std::vector<std::unique_ptr<MemoryBlock>>> pools;
+    std::array<VkDeviceSize, static_cast<size_t>(MemoryCategory::Count)> categoryBytes{};
+
+    uint32_t poolKey(uint32_t memoryType, bool linear) const;
+    VkDeviceSize blockSizeFor(uint32_t memoryType) const;
+    MemoryBlock* createBlock(uint32_t pool, uint32_t memoryType, VkDeviceSize size, bool dedicated);
+    void destroyBlock(MemoryBlock* block);
+    bool allocateFromBlock(MemoryBlock& block, const VkMemoryRequirements& requirements, MemoryAllocation& allocation);
+    uint32_t totalBlockCount() const;
+};
+
+#endif // DEVICEMEMORYALLOCATOR_H
@@ -0,0 +1,25 @@
+#ifndef EMBEDDEDSHADERS_H
+#define EMBEDDEDSHADERS_H
+
+#include <cstdint>
+
+// SPIR-V of every shader in shader/, generated at build time by `glslc -mfmt=c`
+// into the build tree's shader directory and compiled straight into the executable.
+
+inline constexpr uint32_t BASE_VERT_SPIRV[] =
+#include "base.vert.inc"
+;
+
+inline constexpr uint32_t BASE_INSTANCED_VERT_SPIRV[] =
+#include "base_instanced.vert.inc"
+;
+
+inline constexpr uint32_t BASE_FRAG_SPIRV[] =
+#include "base.frag.inc"
+;
+
+inline constexpr uint32_t CULL_COMP_SPIRV[] =
+#include "cull.comp.inc"
+;
+
+#endif // EMBEDDEDSHADERS_H
@@ -0,0 +1,64 @@
+#include "framelinearallocator.h"
+#include <stdexcept>
+#include <algorithm>
+
+void FrameLinearAllocator::init(VkBuffer buffer, void *mapped, VkDeviceSize regionSize, uint32_t regionCount, VkDeviceSize minAlignment)
+{
+    this->buffer = buffer;
+    this->mapped = static_cast<char*>(mapped);
+    this->regionSize = regionSize;
+    this->regionCount = regionCount;
+    this->minAlignment = std::max<VkDeviceSize>(minAlignment, 1);
+    regionBegin = 0;
+    head = 0;
+}
+
+void FrameLinearAllocator::beginFrame(uint32_t frameIndex)
+{
+    if(frameIndex >= regionCount){
+        throw std::runtime_error("Frame index outside of linear allocator regions!");
+    }
+    regionBegin = regionSize * frameIndex;
+    head = regionBegin;
+}
+
+LinearAllocation FrameLinearAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+    alignment = std::max(alignment, minAlignment);
+    VkDeviceSize regionEnd = regionBegin + regionSize;
+
+    VkDeviceSize current = head.load(std::memory_order_relaxed);
+    VkDeviceSize offset;
+    do {
+        offset = (current + alignment - 1) / alignment * alignment;
+        if(offset + size > regionEnd){
+            throw std::runtime_error("Frame linear allocator out of space!");
+        }
+    } while(!head.compare_exchange_weak(current, offset + size, std::memory_order_relaxed));
+
+    LinearAllocation allocation{};
+    allocation.buffer = buffer;
+    allocation.offset = offset;
+    allocation.data = mapped + offset;
+    return allocation;
+}
+
+VkDeviceSize FrameLinearAllocator::alignSize(VkDeviceSize size) const
+{
+    return (size + minAlignment - 1) / minAlignment * minAlignment;
+}
+
+VkBuffer FrameLinearAllocator::getBuffer() const
+{
+    return buffer;
+}
+
+VkDeviceSize FrameLinearAllocator::getRegionSize() const
+{
+    return regionSize;
+}
+
+VkDeviceSize FrameLinearAllocator::getUsedBytes() const
+{
+    return head.load(std::memory_order_relaxed) - regionBegin;
+}
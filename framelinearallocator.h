@@ -0,0 +1,54 @@
+#ifndef FRAMELINEARALLOCATOR_H
+#define FRAMELINEARALLOCATOR_H
+
+#ifndef GLFW_INCLUDE_VULKAN
+    #define GLFW_INCLUDE_VULKAN
+    #include <GLFW/glfw3.h>
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+struct LinearAllocation{
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    void* data = nullptr;
+};
+
+// Bump allocator over one persistently mapped buffer split into a region per frame in flight.
+// A region is reused only after beginFrame() is called for it, i.e. once its frame fence has retired.
+class FrameLinearAllocator
+{
+public:
+    void init(VkBuffer buffer, void* mapped, VkDeviceSize regionSize, uint32_t regionCount, VkDeviceSize minAlignment);
+
+    void beginFrame(uint32_t frameIndex);
+    LinearAllocation allocate(VkDeviceSize size, VkDeviceSize alignment = 0);
+
+    template<typename T>
+    LinearAllocation push(const T& value){
+        LinearAllocation allocation = allocate(sizeof(T));
+        memcpy(allocation.data, &value, sizeof(T));
+        return allocation;
+    }
+
+    // Rounds size up so consecutive sub-ranges of one allocation stay offset-aligned
+    VkDeviceSize alignSize(VkDeviceSize size) const;
+
+    VkBuffer getBuffer() const;
+    VkDeviceSize getRegionSize() const;
+    VkDeviceSize getUsedBytes() const;
+
+private:
+    VkBuffer buffer = VK_NULL_HANDLE;
+    char* mapped = nullptr;
+    VkDeviceSize regionSize = 0;
+    uint32_t regionCount = 0;
+    VkDeviceSize minAlignment = 1;
+
+    VkDeviceSize regionBegin = 0;
+    std::atomic<VkDeviceSize> head{0};
+};
+
+#endif // FRAMELINEARALLOCATOR_H
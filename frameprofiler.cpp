@@ -0,0 +1,259 @@
+#include "frameprofiler.h"
+#include <stdexcept>
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+static constexpr uint32_t GPU_THREAD = 1000;
+
+FrameProfiler::Scope::Scope(FrameProfiler &profiler, const char *name) : profiler(profiler), name(name)
+{
+    beginNs = profiler.isEnabled() ? profiler.nowNs() : 0;
+}
+
+FrameProfiler::Scope::~Scope()
+{
+    if(profiler.isEnabled()){
+        profiler.addEvent(name, beginNs, profiler.nowNs());
+    }
+}
+
+void FrameProfiler::setEnabled(bool enabled)
+{
+    this->enabled = enabled;
+}
+
+bool FrameProfiler::isEnabled() const
+{
+    return enabled;
+}
+
+void FrameProfiler::initGpu(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, uint32_t slotCount)
+{
+    if(!enabled) return;
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+    uint32_t validBits = families[queueFamily].timestampValidBits;
+    if(validBits == 0){
+        // CPU scopes still work, the GPU track simply stays empty
+        return;
+    }
+    timestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    timestampPeriod = properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    createInfo.queryCount = slotCount * MAX_GPU_SCOPES * 2;
+
+    if(vkCreateQueryPool(device, &createInfo, nullptr, &queryPool) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create timestamp query pool!");
+    }
+    this->device = device;
+    gpuSlots.assign(slotCount, GpuSlot{});
+}
+
+void FrameProfiler::destroy()
+{
+    if(queryPool != VK_NULL_HANDLE){
+        vkDestroyQueryPool(device, queryPool, nullptr);
+        queryPool = VK_NULL_HANDLE;
+    }
+    gpuSlots.clear();
+}
+
+void FrameProfiler::beginFrame()
+{
+    if(!enabled) return;
+
+    uint64_t number = frameNumber.load(std::memory_order_relaxed) + 1;
+    FrameRecord& record = frames[number % FRAME_HISTORY];
+    record.eventCount.store(0, std::memory_order_relaxed);
+    record.beginNs = nowNs();
+    record.frameNumber = number;
+    frameNumber.store(number, std::memory_order_release);
+}
+
+uint64_t FrameProfiler::nowNs() const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void FrameProfiler::addEvent(const char *name, uint64_t beginNs, uint64_t endNs, bool gpu)
+{
+    if(!enabled) return;
+
+    ProfileEvent event;
+    event.name = name;
+    event.beginNs = beginNs;
+    event.endNs = endNs;
+    event.thread = gpu ? GPU_THREAD : threadIndex();
+    event.gpu = gpu;
+    appendEvent(frameNumber.load(std::memory_order_acquire), event);
+}
+
+void FrameProfiler::resetGpuQueries(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+    if(queryPool == VK_NULL_HANDLE) return;
+
+    vkCmdResetQueryPool(commandBuffer, queryPool, slot * MAX_GPU_SCOPES * 2, MAX_GPU_SCOPES * 2);
+    gpuSlots[slot].frameNumber = frameNumber.load(std::memory_order_relaxed);
+    gpuSlots[slot].scopeCount = 0;
+}
+
+uint32_t FrameProfiler::beginGpuScope(VkCommandBuffer commandBuffer, uint32_t slot, const char *name)
+{
+    if(queryPool == VK_NULL_HANDLE || gpuSlots[slot].scopeCount == MAX_GPU_SCOPES) return UINT32_MAX;
+
+    uint32_t scope = gpuSlots[slot].scopeCount++;
+    gpuSlots[slot].names[scope] = name;
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, (slot * MAX_GPU_SCOPES + scope) * 2);
+    return scope;
+}
+
+void FrameProfiler::endGpuScope(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t scope)
+{
+    if(scope == UINT32_MAX) return;
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, (slot * MAX_GPU_SCOPES + scope) * 2 + 1);
+}
+
+void FrameProfiler::markSubmit(uint32_t slot)
+{
+    if(queryPool == VK_NULL_HANDLE) return;
+
+    gpuSlots[slot].submitNs = nowNs();
+}
+
+void FrameProfiler::collectGpu(uint32_t slot)
+{
+    if(queryPool == VK_NULL_HANDLE) return;
+
+    GpuSlot& gpuSlot = gpuSlots[slot];
+    if(gpuSlot.scopeCount == 0) return;
+
+    std::array<uint64_t, MAX_GPU_SCOPES * 2> timestamps{};
+    VkResult res = vkGetQueryPoolResults(device, queryPool, slot * MAX_GPU_SCOPES * 2, gpuSlot.scopeCount * 2,
+                                         sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    uint32_t scopeCount = gpuSlot.scopeCount;
+    gpuSlot.scopeCount = 0;
+    if(res != VK_SUCCESS) return;
+
+    uint64_t origin = timestamps[0] & timestampMask;
+    for(uint32_t i = 0; i < scopeCount; i++){
+        uint64_t begin = ((timestamps[i * 2] & timestampMask) - origin) & timestampMask;
+        uint64_t end = ((timestamps[i * 2 + 1] & timestampMask) - origin) & timestampMask;
+
+        ProfileEvent event;
+        event.name = gpuSlot.names[i];
+        event.beginNs = gpuSlot.submitNs + static_cast<uint64_t>(begin * timestampPeriod);
+        event.endNs = gpuSlot.submitNs + static_cast<uint64_t>(end * timestampPeriod);
+        event.thread = GPU_THREAD;
+        event.gpu = true;
+        appendEvent(gpuSlot.frameNumber, event);
+    }
+}
+
+std::map<std::string, StageTiming> FrameProfiler::computeTimings() const
+{
+    std::map<std::string, std::vector<double>> durations;
+    uint64_t last = frameNumber.load(std::memory_order_acquire);
+    uint64_t first = last >= FRAME_HISTORY ? last - FRAME_HISTORY + 1 : 1;
+
+    // The newest frame is still being filled, so it only closes the frame time of the one before it
+    for(uint64_t number = first; number < last; number++){
+        const FrameRecord& record = frames[number % FRAME_HISTORY];
+        const FrameRecord& next = frames[(number + 1) % FRAME_HISTORY];
+        durations["frame"].push_back((next.beginNs - record.beginNs) / 1e6);
+
+        uint32_t count = std::min(record.eventCount.load(std::memory_order_acquire), MAX_EVENTS_PER_FRAME);
+        for(uint32_t i = 0; i < count; i++){
+            const ProfileEvent& event = record.events[i];
+            std::string name = event.gpu ? std::string("gpu ") + event.name : std::string(event.name);
+            durations[name].push_back((event.endNs - event.beginNs) / 1e6);
+        }
+    }
+
+    std::map<std::string, StageTiming> timings;
+    for(auto& [name, values] : durations){
+        std::sort(values.begin(), values.end());
+        auto percentile = [&values](double p){
+            return values[std::min(values.size() - 1, static_cast<size_t>(p * values.size()))];
+        };
+
+        StageTiming& timing = timings[name];
+        timing.samples = static_cast<uint32_t>(values.size());
+        for(double value : values){
+            timing.mean += value;
+        }
+        timing.mean /= values.size();
+        timing.p50 = percentile(0.50);
+        timing.p95 = percentile(0.95);
+        timing.p99 = percentile(0.99);
+    }
+    return timings;
+}
+
+void FrameProfiler::printPercentiles(std::ostream &out) const
+{
+    auto timings = computeTimings();
+    uint32_t frameSamples = timings.count("frame") ? timings["frame"].samples : 0;
+
+    out << "Frame profile over " << frameSamples << " frames (ms):" << std::endl;
+    for(const auto& [name, timing] : timings){
+        out << "  " << name << ": p50 " << timing.p50 << ", p95 " << timing.p95 << ", p99 " << timing.p99 << std::endl;
+    }
+}
+
+void FrameProfiler::writeChromeTrace(const std::string &path) const
+{
+    std::ofstream file(path);
+    if(!file.is_open()){
+        throw std::runtime_error("Failed to open trace file!");
+    }
+
+    uint64_t last = frameNumber.load(std::memory_order_acquire);
+    uint64_t first = last >= FRAME_HISTORY ? last - FRAME_HISTORY + 1 : 1;
+
+    file << "{\"traceEvents\":[" << std::endl;
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << GPU_THREAD << ",\"args\":{\"name\":\"GPU\"}}";
+    for(uint64_t number = first; number <= last; number++){
+        const FrameRecord& record = frames[number % FRAME_HISTORY];
+        file << "," << std::endl << "{\"name\":\"frame " << number << "\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":"
+             << record.beginNs / 1e3 << "}";
+
+        uint32_t count = std::min(record.eventCount.load(std::memory_order_acquire), MAX_EVENTS_PER_FRAME);
+        for(uint32_t i = 0; i < count; i++){
+            const ProfileEvent& event = record.events[i];
+            file << "," << std::endl << "{\"name\":\"" << event.name << "\",\"cat\":\"" << (event.gpu ? "gpu" : "cpu")
+                 << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+                 << ",\"ts\":" << event.beginNs / 1e3 << ",\"dur\":" << (event.endNs - event.beginNs) / 1e3
+                 << ",\"args\":{\"frame\":" << number << "}}";
+        }
+    }
+    file << std::endl << "]}" << std::endl;
+}
+
+uint32_t FrameProfiler::threadIndex()
+{
+    static std::atomic<uint32_t> nextIndex{0};
+    thread_local uint32_t index = nextIndex.fetch_add(1, std::memory_order_relaxed);
+    return index;
+}
+
+void FrameProfiler::appendEvent(uint64_t frame, const ProfileEvent &event)
+{
+    FrameRecord& record = frames[frame % FRAME_HISTORY];
+    if(record.frameNumber != frame) return;
+
+    uint32_t index = record.eventCount.fetch_add(1, std::memory_order_relaxed);
+    if(index >= MAX_EVENTS_PER_FRAME) return;
+    record.events[index] = event;
+}
@@ -0,0 +1,110 @@
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#ifndef GLFW_INCLUDE_VULKAN
+    #define GLFW_INCLUDE_VULKAN
+    #include <GLFW/glfw3.h>
+#endif
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct StageTiming{
+    uint32_t samples = 0;
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+};
+
+struct ProfileEvent{
+    const char* name = nullptr;
+    uint64_t beginNs = 0;
+    uint64_t endNs = 0;
+    uint32_t thread = 0;
+    bool gpu = false;
+};
+
+// CPU scopes and GPU timestamp pairs collected into a ring of per-frame records.
+// Any thread may append events to the current frame without locking; the ring is read
+// (percentiles, trace export) from the main thread between frames.
+class FrameProfiler
+{
+public:
+    static constexpr uint32_t FRAME_HISTORY = 256;
+    static constexpr uint32_t MAX_EVENTS_PER_FRAME = 64;
+    static constexpr uint32_t MAX_GPU_SCOPES = 8;
+
+    class Scope{
+    public:
+        Scope(FrameProfiler& profiler, const char* name);
+        ~Scope();
+
+    private:
+        FrameProfiler& profiler;
+        const char* name;
+        uint64_t beginNs;
+    };
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+
+    // slotCount is the number of frames in flight, each slot owns its own queries
+    void initGpu(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, uint32_t slotCount);
+    void destroy();
+
+    void beginFrame();
+    uint64_t nowNs() const;
+    void addEvent(const char* name, uint64_t beginNs, uint64_t endNs, bool gpu = false);
+
+    void resetGpuQueries(VkCommandBuffer commandBuffer, uint32_t slot);
+    uint32_t beginGpuScope(VkCommandBuffer commandBuffer, uint32_t slot, const char* name);
+    void endGpuScope(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t scope);
+    // GPU times are placed on the CPU timeline relative to the moment the slot was submitted
+    void markSubmit(uint32_t slot);
+    // Call once the slot's previous submission has completed, before its queries are reset
+    void collectGpu(uint32_t slot);
+
+    // Milliseconds per stage over the frame history, GPU stages are prefixed with "gpu "
+    std::map<std::string, StageTiming> computeTimings() const;
+    void printPercentiles(std::ostream& out) const;
+    void writeChromeTrace(const std::string& path) const;
+
+private:
+    struct FrameRecord{
+        uint64_t frameNumber = 0;
+        uint64_t beginNs = 0;
+        std::atomic<uint32_t> eventCount{0};
+        std::array<ProfileEvent, MAX_EVENTS_PER_FRAME> events;
+    };
+
+    struct GpuSlot{
+        uint64_t frameNumber = 0;
+        uint64_t submitNs = 0;
+        uint32_t scopeCount = 0;
+        std::array<const char*, MAX_GPU_SCOPES> names{};
+    };
+
+    bool enabled = false;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::array<FrameRecord, FRAME_HISTORY> frames;
+    std::atomic<uint64_t> frameNumber{0};
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    double timestampPeriod = 1.0;
+    uint64_t timestampMask = 0;
+    std::vector<GpuSlot> gpuSlots;
+
+    static uint32_t threadIndex();
+    void appendEvent(uint64_t frame, const ProfileEvent& event);
+};
+
+#endif // FRAMEPROFILER_H
@@ -0,0 +1,259 @@
+#include "jobsystem.h"
+#include <algorithm>
+
+#ifdef _WIN32
+    #define NOMINMAX
+    #include <windows.h>
+#elif defined(__linux__)
+    #include <pthread.h>
+    #include <sched.h>
+#endif
+
+static thread_local uint32_t threadIndex = 0;
+
+JobSystem::~JobSystem()
+{
+    shutdown();
+}
+
+void JobSystem::init(uint32_t workerCount, bool pinThreads)
+{
+    threadIndex = 0;
+    queues.clear();
+    for(uint32_t i = 0; i <= workerCount; i++){
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+
+    running = true;
+    if(pinThreads){
+        pinCurrentThread(0);
+    }
+    for(uint32_t i = 1; i <= workerCount; i++){
+        workers.emplace_back([this, i, pinThreads](){
+            threadIndex = i;
+            if(pinThreads){
+                pinCurrentThread(i);
+            }
+            workerLoop(i);
+        });
+    }
+}
+
+void JobSystem::shutdown()
+{
+    if(!running) return;
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        running = false;
+    }
+    wakeUp.notify_all();
+    for(auto& worker : workers){
+        worker.join();
+    }
+    workers.clear();
+}
+
+void JobSystem::run(Job job, JobCounter *counter)
+{
+    if(counter){
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    enqueue([this, job = std::move(job), counter](){
+        job();
+        finish(this, counter);
+    });
+}
+
+void JobSystem::runBackground(Job job, JobCounter *counter)
+{
+    if(counter){
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    Job wrapped = [this, job = std::move(job), counter](){
+        job();
+        finish(this, counter);
+    };
+    if(workers.empty()){
+        wrapped();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(backgroundQueue.mutex);
+        backgroundQueue.jobs.push_back(std::move(wrapped));
+        queuedJobs.fetch_add(1, std::memory_order_release);
+    }
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    wakeUp.notify_one();
+}
+
+void JobSystem::runAfter(JobCounter &dependency, Job job, JobCounter *counter)
+{
+    if(counter){
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    Job wrapped = [this, job = std::move(job), counter](){
+        job();
+        finish(this, counter);
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(dependency.mutex);
+        if(dependency.pending.load(std::memory_order_acquire) != 0){
+            dependency.continuations.push_back(std::move(wrapped));
+            return;
+        }
+    }
+    enqueue(std::move(wrapped));
+}
+
+void JobSystem::wait(JobCounter &counter)
+{
+    Job job;
+    while(counter.pending.load(std::memory_order_acquire) != 0){
+        if(popOrSteal(threadIndex, job, false)){
+            execute(job);
+        } else{
+            std::this_thread::yield();
+        }
+    }
+    // finish() decrements under the counter's lock, so once we get it the counter is no longer touched
+    std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t minBatch, const std::function<void (uint32_t, uint32_t)> &body)
+{
+    if(count == 0) return;
+
+    // A couple of batches per thread leaves room for stealing when batches are uneven
+    uint32_t threads = static_cast<uint32_t>(workers.size()) + 1;
+    uint32_t maxBatches = (count + std::max(minBatch, 1u) - 1) / std::max(minBatch, 1u);
+    uint32_t batches = std::max(1u, std::min(threads * 2, maxBatches));
+    uint32_t batchSize = (count + batches - 1) / batches;
+
+    JobCounter counter;
+    for(uint32_t begin = batchSize; begin < count; begin += batchSize){
+        uint32_t end = std::min(begin + batchSize, count);
+        run([&body, begin, end](){ body(begin, end); }, &counter);
+    }
+    body(0, std::min(batchSize, count));
+    wait(counter);
+}
+
+uint32_t JobSystem::getWorkerCount() const
+{
+    return static_cast<uint32_t>(workers.size());
+}
+
+uint32_t JobSystem::currentThreadIndex()
+{
+    return threadIndex;
+}
+
+void JobSystem::enqueue(Job job)
+{
+    if(workers.empty()){
+        job();
+        return;
+    }
+
+    // Threads outside the pool share the owner's queue
+    uint32_t index = std::min<uint32_t>(threadIndex, static_cast<uint32_t>(queues.size()) - 1);
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->jobs.push_back(std::move(job));
+        queuedJobs.fetch_add(1, std::memory_order_release);
+    }
+    // Taking the sleep lock orders the notify after any worker that is about to wait
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    wakeUp.notify_one();
+}
+
+bool JobSystem::popOrSteal(uint32_t self, Job &job, bool allowBackground)
+{
+    if(queuedJobs.load(std::memory_order_acquire) == 0) return false;
+
+    uint32_t queueCount = static_cast<uint32_t>(queues.size());
+    self = std::min(self, queueCount - 1);
+    {
+        WorkerQueue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if(!own.jobs.empty()){
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    for(uint32_t i = 1; i < queueCount; i++){
+        WorkerQueue& victim = *queues[(self + i) % queueCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if(!victim.jobs.empty()){
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    if(allowBackground){
+        std::lock_guard<std::mutex> lock(backgroundQueue.mutex);
+        if(!backgroundQueue.jobs.empty()){
+            job = std::move(backgroundQueue.jobs.front());
+            backgroundQueue.jobs.pop_front();
+            queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::execute(Job &job)
+{
+    job();
+    job = nullptr;
+}
+
+void JobSystem::workerLoop(uint32_t index)
+{
+    Job job;
+    while(true){
+        if(popOrSteal(index, job, true)){
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeUp.wait(lock, [this](){ return queuedJobs.load(std::memory_order_acquire) != 0 || !running; });
+        if(!running) return;
+    }
+}
+
+void JobSystem::pinCurrentThread(uint32_t core)
+{
+    uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+    core %= cores;
+#ifdef _WIN32
+    SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core);
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+void JobSystem::finish(JobSystem *system, JobCounter *counter)
+{
+    if(!counter) return;
+
+    std::vector<Job> ready;
+    {
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        if(counter->pending.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        ready.swap(counter->continuations);
+    }
+    for(auto& job : ready){
+        system->enqueue(std::move(job));
+    }
+}
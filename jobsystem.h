@@ -0,0 +1,73 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using Job = std::function<void()>;
+
+// Counts unfinished jobs. Jobs queued with runAfter() start once it drops to zero.
+// A counter may be reused once it has been waited on.
+struct JobCounter{
+    std::atomic<uint32_t> pending{0};
+    std::mutex mutex;
+    std::vector<Job> continuations;
+};
+
+// Fixed pool of worker threads, each with its own deque. Workers pop their own newest job
+// and steal the oldest job of the next busy queue when they run dry. The thread that calls
+// wait() (usually the main thread) executes jobs too instead of blocking.
+class JobSystem
+{
+public:
+    ~JobSystem();
+
+    // workerCount excludes the calling thread, 0 runs every job inline on the caller
+    void init(uint32_t workerCount, bool pinThreads = false);
+    void shutdown();
+
+    void run(Job job, JobCounter* counter = nullptr);
+    // Long running work that only pool workers pick up once they have nothing else to do,
+    // so it never stalls a thread waiting on frame work. Runs inline when there are no workers.
+    void runBackground(Job job, JobCounter* counter = nullptr);
+    void runAfter(JobCounter& dependency, Job job, JobCounter* counter = nullptr);
+    void wait(JobCounter& counter);
+
+    // Splits [0, count) into batches of at least minBatch and waits for all of them
+    void parallelFor(uint32_t count, uint32_t minBatch, const std::function<void(uint32_t begin, uint32_t end)>& body);
+
+    uint32_t getWorkerCount() const;
+    // 0 for the thread that initialized the system, 1..workerCount for workers
+    static uint32_t currentThreadIndex();
+
+private:
+    struct WorkerQueue{
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::thread> workers;
+    // One queue per worker plus one for the owning thread at index 0
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    WorkerQueue backgroundQueue;
+    std::atomic<bool> running{false};
+    std::atomic<uint32_t> queuedJobs{0};
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+
+    void enqueue(Job job);
+    bool popOrSteal(uint32_t self, Job& job, bool allowBackground);
+    void execute(Job& job);
+    void workerLoop(uint32_t index);
+    static void pinCurrentThread(uint32_t core);
+    static void finish(JobSystem* system, JobCounter* counter);
+};
+
+#endif // JOBSYSTEM_H
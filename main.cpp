@@ -1,12 +1,118 @@
 #include <iostream>
 #include <stdexcept>
 #include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <string>
 
 #include "appvulkancore.h"
+#include "vertexquantizer.h"
 
-int main(){
-    AppVulkanCore app(600, 800);
+static VkFormat parseFormat(const std::string& name){
+    if(name == "rgba8") return VK_FORMAT_R8G8B8A8_UNORM;
+    if(name == "rgba8-srgb") return VK_FORMAT_R8G8B8A8_SRGB;
+    if(name == "bgra8") return VK_FORMAT_B8G8R8A8_UNORM;
+    if(name == "bgra8-srgb") return VK_FORMAT_B8G8R8A8_SRGB;
+    throw std::runtime_error("Unknown format: " + name);
+}
+
+static AppSettings parseArguments(int argc, char** argv, int& width, int& height){
+    AppSettings settings;
+    for(int i = 1; i < argc; i++){
+        bool hasValue = i + 1 < argc;
+        if(strcmp(argv[i], "--headless") == 0){
+            settings.headless = true;
+        }
+        else if(strcmp(argv[i], "--size") == 0 && hasValue){
+            if(sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0){
+                throw std::runtime_error("Size must be given as <width>x<height>");
+            }
+        }
+        else if(strcmp(argv[i], "--format") == 0 && hasValue){
+            settings.headlessFormat = parseFormat(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--capture") == 0 && hasValue){
+            settings.capturePath = argv[++i];
+        }
+        else if(strcmp(argv[i], "--profile") == 0){
+            settings.profile = true;
+        }
+        else if(strcmp(argv[i], "--trace") == 0 && hasValue){
+            settings.tracePath = argv[++i];
+        }
+        else if(strcmp(argv[i], "--objects") == 0 && hasValue){
+            settings.objectCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if(strcmp(argv[i], "--triangles") == 0 && hasValue){
+            settings.trianglesPerObject = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if(strcmp(argv[i], "--mesh") == 0 && hasValue){
+            settings.meshPath = argv[++i];
+        }
+        else if(strcmp(argv[i], "--optimize-mesh") == 0){
+            settings.optimizeMesh = true;
+        }
+        else if(strcmp(argv[i], "--save-mesh") == 0 && hasValue){
+            settings.saveMeshPath = argv[++i];
+        }
+        else if(strcmp(argv[i], "--instanced") == 0){
+            settings.instanced = true;
+        }
+        else if(strcmp(argv[i], "--gpu-culling") == 0){
+            settings.gpuCulling = true;
+        }
+        else if(strcmp(argv[i], "--vertex-format") == 0 && hasValue){
+            settings.vertexFormat = parseVertexFormat(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--wireframe") == 0){
+            settings.wireframe = true;
+        }
+        else if(strcmp(argv[i], "--greyscale") == 0){
+            settings.greyscale = true;
+        }
+        else if(strcmp(argv[i], "--threads") == 0 && hasValue){
+            settings.workerThreads = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if(strcmp(argv[i], "--pin-threads") == 0){
+            settings.pinThreads = true;
+        }
+        else if(strcmp(argv[i], "--frames-in-flight") == 0 && hasValue){
+            settings.framesInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if(strcmp(argv[i], "--benchmark") == 0 && hasValue){
+            settings.benchmarkFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if(strcmp(argv[i], "--cpu-load") == 0 && hasValue){
+            settings.simulatedCpuLoad = std::stod(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--memory-report") == 0 && hasValue){
+            settings.memoryReportInterval = std::stod(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--memory-report-json") == 0 && hasValue){
+            settings.memoryReportPath = argv[++i];
+        }
+        else if(strcmp(argv[i], "--pipeline-cache") == 0 && hasValue){
+            settings.pipelineCachePath = argv[++i];
+        }
+        else if(strcmp(argv[i], "--no-pipeline-cache") == 0){
+            settings.pipelineCachePath.clear();
+        }
+        else{
+            throw std::runtime_error(std::string("Unknown or incomplete argument: ") + argv[i]);
+        }
+    }
+    // A report file is only written while reports run, so asking for one turns them on
+    if(!settings.memoryReportPath.empty() && settings.memoryReportInterval <= 0){
+        settings.memoryReportInterval = 1.0;
+    }
+    return settings;
+}
+
+int main(int argc, char** argv){
     try {
+        int width = 800, height = 600;
+        AppSettings settings = parseArguments(argc, argv, width, height);
+        AppVulkanCore app(height, width, settings);
         app.run();
     }  catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
@@ -0,0 +1,104 @@
+#include "mappedfile.h"
+#include <stdexcept>
+
+#ifdef _WIN32
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+void MappedFile::open(const std::string &path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(file == INVALID_HANDLE_VALUE){
+        throw std::runtime_error("Failed to open " + path);
+    }
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(file, &fileSize)){
+        CloseHandle(file);
+        throw std::runtime_error("Failed to read the size of " + path);
+    }
+    fileHandle = file;
+    mappedSize = static_cast<size_t>(fileSize.QuadPart);
+
+    // Empty files cannot be mapped, they simply have no data
+    if(mappedSize != 0){
+        mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        mapped = mappingHandle ? MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if(!mapped){
+            close();
+            throw std::runtime_error("Failed to map " + path);
+        }
+    }
+#else
+    int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(descriptor < 0){
+        throw std::runtime_error("Failed to open " + path);
+    }
+    struct stat status;
+    if(fstat(descriptor, &status) != 0){
+        ::close(descriptor);
+        throw std::runtime_error("Failed to read the size of " + path);
+    }
+    mappedSize = static_cast<size_t>(status.st_size);
+
+    if(mappedSize != 0){
+        void* view = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if(view == MAP_FAILED){
+            ::close(descriptor);
+            mappedSize = 0;
+            throw std::runtime_error("Failed to map " + path);
+        }
+        mapped = view;
+        // Mesh data is copied out front to back right after mapping
+        madvise(mapped, mappedSize, MADV_SEQUENTIAL);
+        madvise(mapped, mappedSize, MADV_WILLNEED);
+    }
+    // The mapping keeps its own reference to the file
+    ::close(descriptor);
+#endif
+    opened = true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if(mapped) UnmapViewOfFile(mapped);
+    if(mappingHandle) CloseHandle(mappingHandle);
+    if(fileHandle) CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    if(mapped) munmap(mapped, mappedSize);
+#endif
+    mapped = nullptr;
+    mappedSize = 0;
+    opened = false;
+}
+
+bool MappedFile::isOpen() const
+{
+    return opened;
+}
+
+const void *MappedFile::data() const
+{
+    return mapped;
+}
+
+size_t MappedFile::size() const
+{
+    return mappedSize;
+}
@@ -0,0 +1,130 @@
+#include "meshfile.h"
+#include "atomicfile.h"
+#include <stdexcept>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+static uint64_t alignBlob(uint64_t offset)
+{
+    return (offset + MeshFileHeader::BLOB_ALIGNMENT - 1) / MeshFileHeader::BLOB_ALIGNMENT * MeshFileHeader::BLOB_ALIGNMENT;
+}
+
+template<typename Index>
+static Index maxIndex(const void* data, uint32_t count)
+{
+    // Blobs are 16 byte aligned in a page aligned mapping
+    const Index* indices = static_cast<const Index*>(data);
+    Index result = 0;
+    for(uint32_t i = 0; i < count; i++){
+        result = std::max(result, indices[i]);
+    }
+    return result;
+}
+
+VkDeviceSize Mesh::vertexBytes() const
+{
+    return static_cast<VkDeviceSize>(vertexFormatStride(vertexFormat)) * vertexCount;
+}
+
+VkDeviceSize Mesh::indexBytes() const
+{
+    return static_cast<VkDeviceSize>(indexType == VK_INDEX_TYPE_UINT32 ? 4 : 2) * indexCount;
+}
+
+Mesh loadMeshFile(const MappedFile &file, const std::string &path)
+{
+    MeshFileHeader header;
+    if(file.size() < sizeof(header)){
+        throw std::runtime_error("Mesh file " + path + " is too small for its header");
+    }
+    memcpy(&header, file.data(), sizeof(header));
+
+    if(header.magic != MeshFileHeader::MAGIC){
+        throw std::runtime_error("Mesh file " + path + " has a bad magic number or the other byte order");
+    }
+    if(header.version != MeshFileHeader::VERSION){
+        throw std::runtime_error("Mesh file " + path + " has unsupported version " + std::to_string(header.version));
+    }
+    if(header.vertexFormat > static_cast<uint32_t>(VertexFormat::Snorm16)
+            || header.vertexStride != vertexFormatStride(static_cast<VertexFormat>(header.vertexFormat))){
+        throw std::runtime_error("Mesh file " + path + " has an unknown vertex format");
+    }
+    if(header.indexSize != 2 && header.indexSize != 4){
+        throw std::runtime_error("Mesh file " + path + " has an unsupported index size");
+    }
+    if(header.vertexCount == 0 || header.indexCount == 0 || header.indexCount % 3 != 0){
+        throw std::runtime_error("Mesh file " + path + " has no complete triangles");
+    }
+
+    // Counts are 32-bit, so the products cannot overflow, only the offsets need care
+    uint64_t vertexBytes = static_cast<uint64_t>(header.vertexStride) * header.vertexCount;
+    uint64_t indexBytes = static_cast<uint64_t>(header.indexSize) * header.indexCount;
+    uint64_t size = file.size();
+    bool inside = header.vertexOffset >= sizeof(header) && header.vertexOffset % MeshFileHeader::BLOB_ALIGNMENT == 0
+               && header.indexOffset >= sizeof(header) && header.indexOffset % MeshFileHeader::BLOB_ALIGNMENT == 0
+               && header.vertexOffset <= size && vertexBytes <= size - header.vertexOffset
+               && header.indexOffset <= size && indexBytes <= size - header.indexOffset;
+    if(!inside){
+        throw std::runtime_error("Mesh file " + path + " is truncated or has misplaced data");
+    }
+
+    Mesh mesh;
+    mesh.vertexFormat = static_cast<VertexFormat>(header.vertexFormat);
+    mesh.vertexCount = header.vertexCount;
+    mesh.indexType = header.indexSize == 4 ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16;
+    mesh.indexCount = header.indexCount;
+    mesh.boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    mesh.boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+    mesh.quantization.offset = glm::vec3(header.quantizationOffset[0], header.quantizationOffset[1], header.quantizationOffset[2]);
+    mesh.quantization.scale = glm::vec3(header.quantizationScale[0], header.quantizationScale[1], header.quantizationScale[2]);
+    mesh.vertexData = static_cast<const char*>(file.data()) + header.vertexOffset;
+    mesh.indexData = static_cast<const char*>(file.data()) + header.indexOffset;
+
+    // Dequantization is folded into the object transform, a degenerate one would collapse the mesh
+    if(mesh.vertexFormat != VertexFormat::Float){
+        for(int axis = 0; axis < 3; axis++){
+            if(!std::isfinite(header.quantizationOffset[axis]) || !std::isfinite(header.quantizationScale[axis])
+                    || header.quantizationScale[axis] == 0.0f){
+                throw std::runtime_error("Mesh file " + path + " has an invalid quantization");
+            }
+        }
+    }
+
+    // The device is created without robustBufferAccess, so an index past the vertex buffer would
+    // fetch out of bounds. The upload reads every index right after this anyway.
+    uint32_t largest = mesh.indexType == VK_INDEX_TYPE_UINT32 ? maxIndex<uint32_t>(mesh.indexData, mesh.indexCount)
+                                                               : maxIndex<uint16_t>(mesh.indexData, mesh.indexCount);
+    if(largest >= mesh.vertexCount){
+        throw std::runtime_error("Mesh file " + path + " has index " + std::to_string(largest) + " past its "
+                                 + std::to_string(mesh.vertexCount) + " vertices");
+    }
+    return mesh;
+}
+
+void writeMeshFile(const std::string &path, const Mesh &mesh)
+{
+    MeshFileHeader header;
+    header.vertexFormat = static_cast<uint32_t>(mesh.vertexFormat);
+    header.vertexStride = vertexFormatStride(mesh.vertexFormat);
+    header.vertexCount = mesh.vertexCount;
+    header.indexSize = mesh.indexType == VK_INDEX_TYPE_UINT32 ? 4 : 2;
+    header.indexCount = mesh.indexCount;
+    for(int axis = 0; axis < 3; axis++){
+        header.boundsMin[axis] = mesh.boundsMin[axis];
+        header.boundsMax[axis] = mesh.boundsMax[axis];
+        header.quantizationOffset[axis] = mesh.quantization.offset[axis];
+        header.quantizationScale[axis] = mesh.quantization.scale[axis];
+    }
+    header.vertexOffset = alignBlob(sizeof(header));
+    header.indexOffset = alignBlob(header.vertexOffset + mesh.vertexBytes());
+
+    const char padding[MeshFileHeader::BLOB_ALIGNMENT] = {};
+    writeFileAtomically(path, {
+        {&header, sizeof(header)},
+        {padding, static_cast<size_t>(header.vertexOffset - sizeof(header))},
+        {mesh.vertexData, static_cast<size_t>(mesh.vertexBytes())},
+        {padding, static_cast<size_t>(header.indexOffset - header.vertexOffset - mesh.vertexBytes())},
+        {mesh.indexData, static_cast<size_t>(mesh.indexBytes())},
+    });
+}
@@ -0,0 +1,62 @@
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include "structs.h"
+#include "vertexquantizer.h"
+#include "mappedfile.h"
+
+#include <cstdint>
+#include <string>
+
+// GPU-ready geometry: the vertex and index bytes are exactly what goes into the buffers.
+// The data pointers are not owned, they point into a mapped mesh file or the caller's arrays.
+struct Mesh{
+    VertexFormat vertexFormat = VertexFormat::Float;
+    uint32_t vertexCount = 0;
+    VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+    uint32_t indexCount = 0;
+    // Mesh space, i.e. after dequantization
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    // Compact formats only
+    VertexQuantization quantization;
+    const void* vertexData = nullptr;
+    const void* indexData = nullptr;
+
+    VkDeviceSize vertexBytes() const;
+    VkDeviceSize indexBytes() const;
+};
+
+// A mesh file is this header followed by the vertex and index blobs at 16 byte aligned offsets.
+// Everything is stored in the writer's byte order (the magic does not match on a host with the
+// other one), so loading validates the header and hands out pointers into the mapping.
+struct MeshFileHeader{
+    static constexpr uint32_t MAGIC = 0x534d5a56; // "VZMS"
+    // 2: compact vertices lost their unused normal
+    static constexpr uint32_t VERSION = 2;
+    static constexpr uint64_t BLOB_ALIGNMENT = 16;
+
+    uint32_t magic = MAGIC;
+    uint32_t version = VERSION;
+    uint32_t vertexFormat = 0;
+    uint32_t vertexStride = 0;
+    uint32_t vertexCount = 0;
+    // 2 or 4
+    uint32_t indexSize = 0;
+    uint32_t indexCount = 0;
+    uint32_t reserved = 0;
+    float boundsMin[3] = {};
+    float boundsMax[3] = {};
+    float quantizationOffset[3] = {};
+    float quantizationScale[3] = {};
+    uint64_t vertexOffset = 0;
+    uint64_t indexOffset = 0;
+};
+
+// Throws when the header is malformed, the blobs run past the end of the file or an index is past
+// the last vertex.
+Mesh loadMeshFile(const MappedFile& file, const std::string& path);
+// Replaces path atomically, see writeFileAtomically()
+void writeMeshFile(const std::string& path, const Mesh& mesh);
+
+#endif // MESHFILE_H
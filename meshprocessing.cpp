@@ -0,0 +1,310 @@
+#include "meshprocessing.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+static constexpr uint32_t NO_VERTEX = UINT32_MAX;
+
+// FIFO post-transform cache. A vertex is cached while fewer than cacheSize misses happened since
+// its own miss, so a reset only has to move the miss counter past every stamp.
+class VertexCacheSimulator
+{
+public:
+    VertexCacheSimulator(size_t vertexCount, uint32_t cacheSize) : stamps(vertexCount, 0), cacheSize(cacheSize), time(cacheSize + 1) {}
+
+    uint32_t triangle(const uint32_t* corners){
+        return access(corners[0]) + access(corners[1]) + access(corners[2]);
+    }
+
+    void reset(){
+        time += cacheSize + 1;
+    }
+
+private:
+    std::vector<uint64_t> stamps;
+    uint32_t cacheSize;
+    uint64_t time;
+
+    uint32_t access(uint32_t vertex){
+        if(time - stamps[vertex] < cacheSize) return 0;
+        stamps[vertex] = ++time;
+        return 1;
+    }
+};
+
+VertexCacheStats analyzeVertexCache(const uint32_t *indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+    VertexCacheStats stats;
+    if(indexCount < 3 || vertexCount == 0) return stats;
+
+    VertexCacheSimulator cache(vertexCount, cacheSize);
+    uint64_t misses = 0;
+    for(size_t i = 0; i + 2 < indexCount; i += 3){
+        misses += cache.triangle(&indices[i]);
+    }
+    stats.acmr = static_cast<double>(misses) / (indexCount / 3);
+    stats.atvr = static_cast<double>(misses) / vertexCount;
+    return stats;
+}
+
+std::vector<uint32_t> optimizeVertexCache(uint32_t *indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+    size_t triangleCount = indexCount / 3;
+    std::vector<uint32_t> clusters;
+    if(triangleCount == 0) return clusters;
+
+    // Triangles around every vertex as one flat list, offsets[v] is where vertex v's run starts
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for(size_t i = 0; i < triangleCount * 3; i++){
+        offsets[indices[i] + 1]++;
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for(size_t i = 0; i < triangleCount * 3; i++){
+        adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<uint32_t> live(vertexCount);
+    for(size_t v = 0; v < vertexCount; v++){
+        live[v] = offsets[v + 1] - offsets[v];
+    }
+    std::vector<uint64_t> stamps(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+    uint64_t time = cacheSize + 1;
+    uint32_t cursor = 0;
+
+    auto nextUnfinished = [&](){
+        while(!deadEnds.empty()){
+            uint32_t vertex = deadEnds.back();
+            deadEnds.pop_back();
+            if(live[vertex] > 0) return vertex;
+        }
+        while(cursor < vertexCount && live[cursor] == 0){
+            cursor++;
+        }
+        return cursor < vertexCount ? cursor : NO_VERTEX;
+    };
+
+    // Tipsify (Sander, Nehab, Barczak 2007): emit every open triangle around the fan vertex, then
+    // continue from the emitted vertex that will still be in the cache once its own triangles are done
+    uint32_t fan = nextUnfinished();
+    clusters.push_back(0);
+    while(fan != NO_VERTEX){
+        candidates.clear();
+        for(uint32_t j = offsets[fan]; j < offsets[fan + 1]; j++){
+            uint32_t triangle = adjacency[j];
+            if(emitted[triangle]) continue;
+            emitted[triangle] = true;
+
+            for(uint32_t corner = 0; corner < 3; corner++){
+                uint32_t vertex = indices[triangle * 3 + corner];
+                output.push_back(vertex);
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                live[vertex]--;
+                if(time - stamps[vertex] > cacheSize){
+                    stamps[vertex] = time++;
+                }
+            }
+        }
+
+        uint32_t next = NO_VERTEX;
+        int64_t bestPriority = -1;
+        for(uint32_t vertex : candidates){
+            if(live[vertex] == 0) continue;
+
+            int64_t priority = 0;
+            if(time - stamps[vertex] + 2 * live[vertex] <= cacheSize){
+                priority = static_cast<int64_t>(time - stamps[vertex]);
+            }
+            if(priority > bestPriority){
+                bestPriority = priority;
+                next = vertex;
+            }
+        }
+        if(next == NO_VERTEX){
+            next = nextUnfinished();
+            if(next != NO_VERTEX){
+                clusters.push_back(static_cast<uint32_t>(output.size() / 3));
+            }
+        }
+        fan = next;
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+    return clusters;
+}
+
+void optimizeOverdraw(uint32_t *indices, size_t indexCount, const std::vector<uint32_t> &clusters,
+                      const glm::vec3 *positions, size_t vertexCount, uint32_t cacheSize, float threshold)
+{
+    uint32_t triangleCount = static_cast<uint32_t>(indexCount / 3);
+    if(triangleCount == 0 || clusters.empty()) return;
+
+    // Soft boundaries (Sander et al.): a cluster is split as soon as its triangles so far reach
+    // the ACMR of the whole cluster within the threshold, so splitting costs little cache efficiency
+    std::vector<uint32_t> boundaries;
+    VertexCacheSimulator cache(vertexCount, cacheSize);
+    for(size_t c = 0; c < clusters.size(); c++){
+        uint32_t begin = clusters[c];
+        uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+        cache.reset();
+        uint32_t clusterMisses = 0;
+        for(uint32_t t = begin; t < end; t++){
+            clusterMisses += cache.triangle(&indices[t * 3]);
+        }
+        float limit = threshold * clusterMisses / (end - begin);
+
+        cache.reset();
+        boundaries.push_back(begin);
+        uint32_t splitBegin = begin;
+        uint32_t misses = 0;
+        for(uint32_t t = begin; t + 1 < end; t++){
+            misses += cache.triangle(&indices[t * 3]);
+            if(misses <= limit * (t + 1 - splitBegin)){
+                boundaries.push_back(t + 1);
+                splitBegin = t + 1;
+                misses = 0;
+                cache.reset();
+            }
+        }
+    }
+
+    glm::vec3 meshCenter(0.0f);
+    for(size_t i = 0; i < indexCount; i++){
+        meshCenter += positions[indices[i]];
+    }
+    meshCenter /= static_cast<float>(indexCount);
+
+    // Clusters on the outside facing outwards occlude the rest, so they go first
+    struct Cluster{
+        uint32_t begin;
+        uint32_t end;
+        float sortKey;
+    };
+    std::vector<Cluster> sorted(boundaries.size());
+    for(size_t c = 0; c < boundaries.size(); c++){
+        Cluster& cluster = sorted[c];
+        cluster.begin = boundaries[c];
+        cluster.end = c + 1 < boundaries.size() ? boundaries[c + 1] : triangleCount;
+
+        // Cross products are area weighted, so summing them weights centroids and normals by area
+        glm::vec3 center(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for(uint32_t t = cluster.begin; t < cluster.end; t++){
+            glm::vec3 a = positions[indices[t * 3]];
+            glm::vec3 b = positions[indices[t * 3 + 1]];
+            glm::vec3 d = positions[indices[t * 3 + 2]];
+            glm::vec3 weighted = glm::cross(b - a, d - a);
+            float triangleArea = glm::length(weighted);
+            center += (a + b + d) * (triangleArea / 3.0f);
+            normal += weighted;
+            area += triangleArea;
+        }
+        float normalLength = glm::length(normal);
+        cluster.sortKey = 0.0f;
+        if(area > 0.0f && normalLength > 0.0f){
+            cluster.sortKey = glm::dot(center / area - meshCenter, normal / normalLength);
+        }
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b){ return a.sortKey > b.sortKey; });
+
+    std::vector<uint32_t> reordered;
+    reordered.reserve(triangleCount * 3);
+    for(const Cluster& cluster : sorted){
+        reordered.insert(reordered.end(), indices + cluster.begin * 3, indices + cluster.end * 3);
+    }
+    std::copy(reordered.begin(), reordered.end(), indices);
+}
+
+size_t optimizeVertexFetch(uint32_t *indices, size_t indexCount, void *vertices, size_t vertexCount, size_t stride)
+{
+    std::vector<uint32_t> remap(vertexCount, NO_VERTEX);
+    uint32_t next = 0;
+    for(size_t i = 0; i < indexCount; i++){
+        uint32_t& target = remap[indices[i]];
+        if(target == NO_VERTEX){
+            target = next++;
+        }
+        indices[i] = target;
+    }
+
+    char* data = static_cast<char*>(vertices);
+    std::vector<char> original(data, data + vertexCount * stride);
+    for(size_t v = 0; v < vertexCount; v++){
+        if(remap[v] != NO_VERTEX){
+            memcpy(data + remap[v] * stride, original.data() + v * stride, stride);
+        }
+    }
+    return next;
+}
+
+static glm::vec3 decodePosition(const Mesh& mesh, const char* vertex)
+{
+    if(mesh.vertexFormat == VertexFormat::Snorm16){
+        Snorm16Vertex compact;
+        memcpy(&compact, vertex, sizeof(compact));
+        glm::vec3 normalized(compact.pos[0] / 32767.0f, compact.pos[1] / 32767.0f, compact.pos[2] / 32767.0f);
+        return normalized * mesh.quantization.scale + mesh.quantization.offset;
+    }
+    if(mesh.vertexFormat == VertexFormat::Half){
+        HalfVertex compact;
+        memcpy(&compact, vertex, sizeof(compact));
+        glm::vec3 normalized(halfToFloat(compact.pos[0]), halfToFloat(compact.pos[1]), halfToFloat(compact.pos[2]));
+        return normalized * mesh.quantization.scale + mesh.quantization.offset;
+    }
+    Vertex full;
+    memcpy(&full, vertex, sizeof(full));
+    return full.pos;
+}
+
+MeshOptimizationReport optimizeMesh(Mesh &mesh, void *vertices, void *indices, uint32_t cacheSize, float overdrawThreshold)
+{
+    // The passes work on 32-bit indices, 16-bit meshes are widened and narrowed again at the end
+    std::vector<uint32_t> wide(mesh.indexCount);
+    if(mesh.indexType == VK_INDEX_TYPE_UINT32){
+        memcpy(wide.data(), indices, mesh.indexBytes());
+    } else{
+        std::vector<uint16_t> narrow(mesh.indexCount);
+        memcpy(narrow.data(), indices, mesh.indexBytes());
+        std::copy(narrow.begin(), narrow.end(), wide.begin());
+    }
+    for(uint32_t index : wide){
+        if(index >= mesh.vertexCount){
+            throw std::runtime_error("Mesh index " + std::to_string(index) + " is out of range");
+        }
+    }
+
+    MeshOptimizationReport report;
+    report.verticesBefore = mesh.vertexCount;
+    report.before = analyzeVertexCache(wide.data(), wide.size(), mesh.vertexCount, cacheSize);
+
+    size_t stride = vertexFormatStride(mesh.vertexFormat);
+    std::vector<glm::vec3> positions(mesh.vertexCount);
+    for(uint32_t v = 0; v < mesh.vertexCount; v++){
+        positions[v] = decodePosition(mesh, static_cast<const char*>(vertices) + v * stride);
+    }
+
+    std::vector<uint32_t> clusters = optimizeVertexCache(wide.data(), wide.size(), mesh.vertexCount, cacheSize);
+    optimizeOverdraw(wide.data(), wide.size(), clusters, positions.data(), mesh.vertexCount, cacheSize, overdrawThreshold);
+    mesh.vertexCount = static_cast<uint32_t>(optimizeVertexFetch(wide.data(), wide.size(), vertices, mesh.vertexCount, stride));
+
+    report.verticesAfter = mesh.vertexCount;
+    report.after = analyzeVertexCache(wide.data(), wide.size(), mesh.vertexCount, cacheSize);
+
+    if(mesh.indexType == VK_INDEX_TYPE_UINT32){
+        memcpy(indices, wide.data(), mesh.indexBytes());
+    } else{
+        std::vector<uint16_t> narrow(wide.begin(), wide.end());
+        memcpy(indices, narrow.data(), mesh.indexBytes());
+    }
+    return report;
+}
@@ -0,0 +1,52 @@
+#ifndef MESHPROCESSING_H
+#define MESHPROCESSING_H
+
+#include "meshfile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Offline reordering of index and vertex data, none of it changes what is drawn:
+//   optimizeVertexCache - Tipsify triangle order for post-transform cache hits
+//   optimizeOverdraw    - moves whole cache friendly clusters so outward facing ones draw first
+//   optimizeVertexFetch - renumbers vertices in first use order so fetches walk memory linearly
+// The passes are meant to run in that order, optimizeMesh() does all three on a Mesh.
+
+// Post-transform caches of current GPUs behave roughly like a FIFO of this many vertices
+static constexpr uint32_t DEFAULT_VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats{
+    // Vertex shader invocations per triangle: 3 worst, about 0.5 best for a regular grid
+    double acmr = 0.0;
+    // Vertex shader invocations per vertex: 1 is ideal
+    double atvr = 0.0;
+};
+
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount,
+                                    uint32_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
+
+// Returns the first triangle of every cluster, the runs between restarts of the fan walk
+std::vector<uint32_t> optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount,
+                                          uint32_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
+// Clusters are split further where their ACMR stays within threshold of the whole cluster, then
+// sorted by how far they face away from the mesh center
+void optimizeOverdraw(uint32_t* indices, size_t indexCount, const std::vector<uint32_t>& clusters,
+                      const glm::vec3* positions, size_t vertexCount,
+                      uint32_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE, float threshold = 1.05f);
+// Unreferenced vertices are dropped, returns the new vertex count
+size_t optimizeVertexFetch(uint32_t* indices, size_t indexCount, void* vertices, size_t vertexCount, size_t stride);
+
+struct MeshOptimizationReport{
+    VertexCacheStats before;
+    VertexCacheStats after;
+    uint32_t verticesBefore = 0;
+    uint32_t verticesAfter = 0;
+};
+
+// Runs all passes in place. vertices and indices are writable buffers holding exactly what
+// mesh.vertexData and mesh.indexData describe, mesh.vertexCount is updated.
+MeshOptimizationReport optimizeMesh(Mesh& mesh, void* vertices, void* indices,
+                                    uint32_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE, float overdrawThreshold = 1.05f);
+
+#endif // MESHPROCESSING_H
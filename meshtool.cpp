@@ -0,0 +1,84 @@
+#include <iostream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "meshfile.h"
+#include "meshprocessing.h"
+
+// Reorders a mesh file offline for vertex cache hits, overdraw and vertex fetch locality, and prints
+// the vertex cache statistics before and after. Without an output path nothing is written.
+
+struct ToolOptions{
+    std::string inputPath;
+    std::string outputPath;
+    uint32_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE;
+    float overdrawThreshold = 1.05f;
+};
+
+static ToolOptions parseArguments(int argc, char** argv){
+    ToolOptions options;
+    for(int i = 1; i < argc; i++){
+        bool hasValue = i + 1 < argc;
+        if(strcmp(argv[i], "--cache-size") == 0 && hasValue){
+            options.cacheSize = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if(strcmp(argv[i], "--overdraw-threshold") == 0 && hasValue){
+            options.overdrawThreshold = std::stof(argv[++i]);
+        }
+        else if(argv[i][0] != '-' && options.inputPath.empty()){
+            options.inputPath = argv[i];
+        }
+        else if(argv[i][0] != '-' && options.outputPath.empty()){
+            options.outputPath = argv[i];
+        }
+        else{
+            throw std::runtime_error(std::string("Unknown or incomplete argument: ") + argv[i]);
+        }
+    }
+    if(options.inputPath.empty() || options.cacheSize == 0){
+        throw std::runtime_error("Usage: vulkan-zabawa-meshtool <input mesh> [output mesh] [--cache-size N] [--overdraw-threshold X]");
+    }
+    return options;
+}
+
+int main(int argc, char** argv){
+    try {
+        ToolOptions options = parseArguments(argc, argv);
+
+        // Copied out so the input can be closed before the output is renamed over it
+        std::vector<char> vertices;
+        std::vector<char> indices;
+        Mesh mesh;
+        {
+            MappedFile file;
+            file.open(options.inputPath);
+            mesh = loadMeshFile(file, options.inputPath);
+            const char* vertexData = static_cast<const char*>(mesh.vertexData);
+            const char* indexData = static_cast<const char*>(mesh.indexData);
+            vertices.assign(vertexData, vertexData + mesh.vertexBytes());
+            indices.assign(indexData, indexData + mesh.indexBytes());
+            mesh.vertexData = vertices.data();
+            mesh.indexData = indices.data();
+        }
+        std::cout << options.inputPath << ": " << mesh.vertexCount << " " << vertexFormatName(mesh.vertexFormat) << " vertices, "
+                  << mesh.indexCount / 3 << " triangles, " << (mesh.indexType == VK_INDEX_TYPE_UINT32 ? 32 : 16) << "-bit indices" << std::endl;
+
+        MeshOptimizationReport report = optimizeMesh(mesh, vertices.data(), indices.data(), options.cacheSize, options.overdrawThreshold);
+        std::cout << "Vertex cache (" << options.cacheSize << " entries):" << std::endl
+                  << "  before: ACMR " << report.before.acmr << ", ATVR " << report.before.atvr << ", " << report.verticesBefore << " vertices" << std::endl
+                  << "  after:  ACMR " << report.after.acmr << ", ATVR " << report.after.atvr << ", " << report.verticesAfter << " vertices" << std::endl;
+
+        if(!options.outputPath.empty()){
+            writeMeshFile(options.outputPath, mesh);
+            std::cout << "Optimized mesh written to " << options.outputPath << std::endl;
+        }
+    }  catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
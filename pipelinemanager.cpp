@@ -0,0 +1,213 @@
+#include "pipelinemanager.h"
+#include <stdexcept>
+#include <iostream>
+
+void PipelineManager::init(VkDevice device, VkPipelineCache pipelineCache, JobSystem &jobs, const Description &description, VkRenderPass renderPass)
+{
+    this->device = device;
+    this->pipelineCache = pipelineCache;
+    this->jobs = &jobs;
+    this->description = description;
+    this->renderPass = renderPass;
+}
+
+void PipelineManager::destroy()
+{
+    jobs->wait(pendingCompiles);
+    for(Entry& entry : entries){
+        VkPipeline pipeline = entry.pipeline.exchange(VK_NULL_HANDLE);
+        if(pipeline != VK_NULL_HANDLE){
+            vkDestroyPipeline(device, pipeline, nullptr);
+        }
+    }
+    entries.clear();
+}
+
+PipelineHandle PipelineManager::request(const PipelineVariant &variant, bool wait)
+{
+    Entry* entry = nullptr;
+    PipelineHandle handle = 0;
+    bool created = false;
+    {
+        std::lock_guard<std::mutex> lock(entriesMutex);
+        for(size_t i = 0; i < entries.size() && !entry; i++){
+            if(entries[i].variant == variant){
+                entry = &entries[i];
+                handle = static_cast<PipelineHandle>(i);
+            }
+        }
+        if(!entry){
+            handle = static_cast<PipelineHandle>(entries.size());
+            entry = &entries.emplace_back();
+            entry->variant = variant;
+            entry->waited = wait;
+            created = true;
+        }
+    }
+
+    if(created){
+        schedule(*entry, wait);
+    } else if(wait && entry->pipeline.load(std::memory_order_acquire) == VK_NULL_HANDLE){
+        jobs->wait(pendingCompiles);
+    }
+    return handle;
+}
+
+bool PipelineManager::isReady(PipelineHandle handle) const
+{
+    std::lock_guard<std::mutex> lock(entriesMutex);
+    return handle < entries.size() && entries[handle].pipeline.load(std::memory_order_acquire) != VK_NULL_HANDLE;
+}
+
+VkPipeline PipelineManager::get(PipelineHandle handle, PipelineHandle fallback) const
+{
+    std::lock_guard<std::mutex> lock(entriesMutex);
+    VkPipeline pipeline = entries[handle].pipeline.load(std::memory_order_acquire);
+    return pipeline != VK_NULL_HANDLE ? pipeline : entries[fallback].pipeline.load(std::memory_order_acquire);
+}
+
+std::vector<VkPipeline> PipelineManager::setRenderPass(VkRenderPass renderPass)
+{
+    jobs->wait(pendingCompiles);
+    this->renderPass = renderPass;
+
+    std::vector<VkPipeline> retired;
+    for(Entry& entry : entries){
+        VkPipeline pipeline = entry.pipeline.exchange(VK_NULL_HANDLE);
+        if(pipeline != VK_NULL_HANDLE){
+            retired.push_back(pipeline);
+        }
+        schedule(entry, entry.waited);
+    }
+    return retired;
+}
+
+uint32_t PipelineManager::getCompiledCount() const
+{
+    return compiledCount.load(std::memory_order_relaxed);
+}
+
+void PipelineManager::schedule(Entry &entry, bool wait)
+{
+    VkRenderPass targetPass = renderPass.load();
+    if(wait){
+        entry.pipeline.store(compile(entry.variant, targetPass), std::memory_order_release);
+        return;
+    }
+    // A failed variant stays on its fallback instead of taking the worker thread down
+    jobs->runBackground([this, &entry, targetPass](){
+        try {
+            entry.pipeline.store(compile(entry.variant, targetPass), std::memory_order_release);
+        } catch (const std::exception& e) {
+            std::cerr << "Pipeline variant: " << e.what() << std::endl;
+        }
+    }, &pendingCompiles);
+}
+
+VkPipeline PipelineManager::compile(const PipelineVariant &variant, VkRenderPass renderPass) const
+{
+    std::array<VkSpecializationMapEntry, 4> specializationEntries;
+    for(uint32_t i = 0; i < specializationEntries.size(); i++){
+        specializationEntries[i].constantID = i;
+        specializationEntries[i].offset = i * sizeof(int32_t);
+        specializationEntries[i].size = sizeof(int32_t);
+    }
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = specializationEntries.size();
+    specializationInfo.pMapEntries = specializationEntries.data();
+    specializationInfo.dataSize = sizeof(variant.constants);
+    specializationInfo.pData = variant.constants.data();
+
+    VkPipelineShaderStageCreateInfo shaderStages[2]{};
+    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[0].module = description.vertexShader;
+    shaderStages[0].pName = "main";
+    shaderStages[0].pSpecializationInfo = &specializationInfo;
+    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderStages[1].module = description.fragmentShader;
+    shaderStages[1].pName = "main";
+    shaderStages[1].pSpecializationInfo = &specializationInfo;
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.vertexBindingDescriptionCount = description.bindings.size();
+    vertexInputInfo.pVertexBindingDescriptions = description.bindings.data();
+    vertexInputInfo.vertexAttributeDescriptionCount = description.attributes.size();
+    vertexInputInfo.pVertexAttributeDescriptions = description.attributes.data();
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = variant.topology;
+    inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+    // Viewport and scissor are set while recording, so pipelines survive swapchain resizes
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = variant.polygonMode;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = variant.cullMode;
+    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterizer.depthBiasEnable = VK_FALSE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachement{};
+    colorBlendAttachement.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachement.blendEnable = variant.blend ? VK_TRUE : VK_FALSE;
+    colorBlendAttachement.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    colorBlendAttachement.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachement.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachement.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachement.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendAttachement.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.logicOpEnable = VK_FALSE;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachement;
+
+    VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = 2;
+    dynamicState.pDynamicStates = dynamicStates;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = shaderStages;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pDepthStencilState = nullptr;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = description.layout;
+    pipelineInfo.renderPass = renderPass;
+    pipelineInfo.subpass = 0;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    // The cache is internally synchronized, so workers can compile against it concurrently
+    VkPipeline pipeline;
+    if(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create graphics pipeline!");
+    }
+    compiledCount.fetch_add(1, std::memory_order_relaxed);
+    return pipeline;
+}
@@ -0,0 +1,86 @@
+#ifndef PIPELINEMANAGER_H
+#define PIPELINEMANAGER_H
+
+#ifndef GLFW_INCLUDE_VULKAN
+    #define GLFW_INCLUDE_VULKAN
+    #include <GLFW/glfw3.h>
+#endif
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "jobsystem.h"
+
+// Fixed-function state and specialization constants that tell pipelines of one shader pair apart
+struct PipelineVariant{
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    // Standard alpha blending instead of overwriting the target
+    bool blend = false;
+    // Specialization constants 0..3, visible to both stages
+    std::array<int32_t, 4> constants{};
+
+    bool operator==(const PipelineVariant& other) const = default;
+};
+
+// Index of a variant, stays valid for the lifetime of the manager and across render pass changes
+using PipelineHandle = uint32_t;
+
+// Owns every pipeline variant built from one vertex/fragment shader pair and one layout.
+// Variants compile as background jobs; until one is ready, get() hands out a fallback instead.
+class PipelineManager
+{
+public:
+    struct Description{
+        // Owned by the caller and kept alive while the manager exists
+        VkShaderModule vertexShader = VK_NULL_HANDLE;
+        VkShaderModule fragmentShader = VK_NULL_HANDLE;
+        std::vector<VkVertexInputBindingDescription> bindings;
+        std::vector<VkVertexInputAttributeDescription> attributes;
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+    };
+
+    void init(VkDevice device, VkPipelineCache pipelineCache, JobSystem& jobs, const Description& description, VkRenderPass renderPass);
+    // Waits for outstanding compiles and destroys every pipeline
+    void destroy();
+
+    // Returns the existing handle for an equal variant. New variants are compiled in the background,
+    // or before returning when wait is set (used for the fallback every other variant relies on)
+    PipelineHandle request(const PipelineVariant& variant, bool wait = false);
+    bool isReady(PipelineHandle handle) const;
+    VkPipeline get(PipelineHandle handle, PipelineHandle fallback) const;
+
+    // Pipelines are tied to the render pass; the old ones are handed back for deferred destruction
+    // and every known variant is compiled again, the ones requested with wait before returning
+    std::vector<VkPipeline> setRenderPass(VkRenderPass renderPass);
+
+    uint32_t getCompiledCount() const;
+
+private:
+    struct Entry{
+        PipelineVariant variant;
+        bool waited = false;
+        std::atomic<VkPipeline> pipeline{VK_NULL_HANDLE};
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    JobSystem* jobs = nullptr;
+    Description description;
+    std::atomic<VkRenderPass> renderPass{VK_NULL_HANDLE};
+
+    // A deque keeps entries in place while compile jobs write to them
+    mutable std::mutex entriesMutex;
+    std::deque<Entry> entries;
+    JobCounter pendingCompiles;
+    mutable std::atomic<uint32_t> compiledCount{0};
+
+    void schedule(Entry& entry, bool wait);
+    VkPipeline compile(const PipelineVariant& variant, VkRenderPass renderPass) const;
+};
+
+#endif // PIPELINEMANAGER_H
@@ -0,0 +1,138 @@
+#include "renderqueue.h"
+#include <array>
+#include <cstring>
+#include <algorithm>
+
+RenderQueueStats &RenderQueueStats::operator+=(const RenderQueueStats &other)
+{
+    draws += other.draws;
+    pipelineBinds += other.pipelineBinds;
+    descriptorBinds += other.descriptorBinds;
+    vertexBufferBinds += other.vertexBufferBinds;
+    indexBufferBinds += other.indexBufferBinds;
+    bindsSkipped += other.bindsSkipped;
+    return *this;
+}
+
+uint64_t RenderQueue::makeSortKey(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth)
+{
+    // Non-negative floats order the same as their bit patterns
+    uint32_t depthBits;
+    depth = std::max(depth, 0.0f);
+    memcpy(&depthBits, &depth, sizeof(depthBits));
+
+    uint64_t key = pipeline & ((1u << PIPELINE_BITS) - 1);
+    key = (key << MATERIAL_BITS) | (material & ((1u << MATERIAL_BITS) - 1));
+    key = (key << MESH_BITS) | (mesh & ((1u << MESH_BITS) - 1));
+    return (key << 32) | depthBits;
+}
+
+void RenderQueue::clear()
+{
+    items.clear();
+    order.clear();
+}
+
+void RenderQueue::submit(const DrawItem &item)
+{
+    order.push_back({item.key, static_cast<uint32_t>(items.size())});
+    items.push_back(item);
+}
+
+void RenderQueue::sort()
+{
+    // One histogram per key byte, all gathered in a single read of the keys
+    std::array<std::array<uint32_t, 256>, 8> histograms{};
+    for(const SortEntry& entry : order){
+        for(uint32_t pass = 0; pass < 8; pass++){
+            histograms[pass][(entry.key >> (pass * 8)) & 0xff]++;
+        }
+    }
+
+    scratch.resize(order.size());
+    for(uint32_t pass = 0; pass < 8; pass++){
+        auto& histogram = histograms[pass];
+        if(order.empty() || histogram[(order[0].key >> (pass * 8)) & 0xff] == order.size()) continue;
+
+        uint32_t offset = 0;
+        for(uint32_t& count : histogram){
+            uint32_t bucketSize = count;
+            count = offset;
+            offset += bucketSize;
+        }
+        for(const SortEntry& entry : order){
+            scratch[histogram[(entry.key >> (pass * 8)) & 0xff]++] = entry;
+        }
+        order.swap(scratch);
+    }
+}
+
+size_t RenderQueue::size() const
+{
+    return order.size();
+}
+
+RenderQueueStats RenderQueue::record(VkCommandBuffer commandBuffer, size_t first, size_t count) const
+{
+    RenderQueueStats stats;
+    VkPipeline boundPipeline = VK_NULL_HANDLE;
+    VkDescriptorSet boundSet = VK_NULL_HANDLE;
+    uint32_t boundOffset = 0;
+    VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+    VkBuffer boundInstanceBuffer = VK_NULL_HANDLE;
+    VkDeviceSize boundInstanceOffset = 0;
+    VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+    VkIndexType boundIndexType = VK_INDEX_TYPE_UINT16;
+
+    for(size_t i = first; i < first + count; i++){
+        const DrawItem& item = items[order[i].item];
+
+        if(item.pipeline != boundPipeline){
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, item.pipeline);
+            boundPipeline = item.pipeline;
+            // A new pipeline may come with an incompatible layout, so the set has to be bound again
+            boundSet = VK_NULL_HANDLE;
+            stats.pipelineBinds++;
+        } else{
+            stats.bindsSkipped++;
+        }
+
+        if(item.descriptorSet != boundSet || item.uniformOffset != boundOffset){
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, item.pipelineLayout, 0, 1, &item.descriptorSet, 1, &item.uniformOffset);
+            boundSet = item.descriptorSet;
+            boundOffset = item.uniformOffset;
+            stats.descriptorBinds++;
+        } else{
+            stats.bindsSkipped++;
+        }
+
+        if(item.vertexBuffer != boundVertexBuffer || item.instanceBuffer != boundInstanceBuffer || item.instanceOffset != boundInstanceOffset){
+            VkBuffer buffers[] = {item.vertexBuffer, item.instanceBuffer};
+            VkDeviceSize offsets[] = {0, item.instanceOffset};
+            vkCmdBindVertexBuffers(commandBuffer, 0, item.instanceBuffer != VK_NULL_HANDLE ? 2 : 1, buffers, offsets);
+            boundVertexBuffer = item.vertexBuffer;
+            boundInstanceBuffer = item.instanceBuffer;
+            boundInstanceOffset = item.instanceOffset;
+            stats.vertexBufferBinds++;
+        } else{
+            stats.bindsSkipped++;
+        }
+
+        if(item.indexBuffer != boundIndexBuffer || item.indexType != boundIndexType){
+            vkCmdBindIndexBuffer(commandBuffer, item.indexBuffer, 0, item.indexType);
+            boundIndexBuffer = item.indexBuffer;
+            boundIndexType = item.indexType;
+            stats.indexBufferBinds++;
+        } else{
+            stats.bindsSkipped++;
+        }
+
+        if(item.indirectBuffer != VK_NULL_HANDLE){
+            vkCmdDrawIndexedIndirect(commandBuffer, item.indirectBuffer, item.indirectOffset, 1, sizeof(VkDrawIndexedIndirectCommand));
+        } else{
+            vkCmdDrawIndexed(commandBuffer, item.indexCount, item.instanceCount, 0, 0, 0);
+        }
+        stats.draws++;
+    }
+    return stats;
+}
@@ -0,0 +1,78 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#ifndef GLFW_INCLUDE_VULKAN
+    #define GLFW_INCLUDE_VULKAN
+    #include <GLFW/glfw3.h>
+#endif
+
+#include <cstdint>
+#include <vector>
+
+// Everything needed to record one draw. Items only reference GPU objects, they never own them.
+struct DrawItem{
+    uint64_t key = 0;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    uint32_t uniformOffset = 0;
+    VkBuffer vertexBuffer = VK_NULL_HANDLE;
+    // Bound at binding 1 when set
+    VkBuffer instanceBuffer = VK_NULL_HANDLE;
+    VkDeviceSize instanceOffset = 0;
+    VkBuffer indexBuffer = VK_NULL_HANDLE;
+    VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+    uint32_t indexCount = 0;
+    uint32_t instanceCount = 1;
+    // When set, the draw parameters come from the VkDrawIndexedIndirectCommand at indirectOffset
+    VkBuffer indirectBuffer = VK_NULL_HANDLE;
+    VkDeviceSize indirectOffset = 0;
+};
+
+struct RenderQueueStats{
+    uint64_t draws = 0;
+    uint64_t pipelineBinds = 0;
+    uint64_t descriptorBinds = 0;
+    uint64_t vertexBufferBinds = 0;
+    uint64_t indexBufferBinds = 0;
+    // Binds a naive one-bind-per-draw submission would have issued on top of the ones above
+    uint64_t bindsSkipped = 0;
+
+    RenderQueueStats& operator+=(const RenderQueueStats& other);
+};
+
+// Collects the draws of a frame, orders them by key and records them skipping binds
+// that would not change the bound state. Keys sort by pipeline, then material
+// (descriptor set), then mesh, then front to back by depth.
+class RenderQueue
+{
+public:
+    static constexpr uint32_t PIPELINE_BITS = 8;
+    static constexpr uint32_t MATERIAL_BITS = 12;
+    static constexpr uint32_t MESH_BITS = 12;
+
+    // Ids are small per-frame indices chosen by the caller, depth is view space distance
+    static uint64_t makeSortKey(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+
+    void clear();
+    void submit(const DrawItem& item);
+    // Stable LSD radix sort over the keys, passes whose byte is equal for every item are skipped
+    void sort();
+
+    size_t size() const;
+    // Records sorted items [first, first + count), state is tracked per call so each
+    // command buffer, e.g. a secondary one, starts with nothing bound
+    RenderQueueStats record(VkCommandBuffer commandBuffer, size_t first, size_t count) const;
+
+private:
+    struct SortEntry{
+        uint64_t key;
+        uint32_t item;
+    };
+
+    std::vector<DrawItem> items;
+    std::vector<SortEntry> order;
+    std::vector<SortEntry> scratch;
+};
+
+#endif // RENDERQUEUE_H
@@ -1,9 +1,15 @@
 #version 450
 
+layout(constant_id = 0) const int COLOR_MODE = 0;
+
 layout(location = 2) in vec3 fragColor;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = vec4(fragColor, 1.0);
+    vec3 color = fragColor;
+    if(COLOR_MODE == 1){
+        color = vec3(dot(fragColor, vec3(0.299, 0.587, 0.114)));
+    }
+    outColor = vec4(color, 1.0);
 }
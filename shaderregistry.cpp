@@ -0,0 +1,66 @@
+#include "shaderregistry.h"
+#include "embeddedshaders.h"
+#include "spirvreflect.h"
+#include "structs.h"
+#include <stdexcept>
+
+struct EmbeddedShader{
+    const char* name;
+    const uint32_t* code;
+    size_t size;
+};
+
+static constexpr EmbeddedShader EMBEDDED_SHADERS[] = {
+    {"base.vert", BASE_VERT_SPIRV, sizeof(BASE_VERT_SPIRV)},
+    {"base_instanced.vert", BASE_INSTANCED_VERT_SPIRV, sizeof(BASE_INSTANCED_VERT_SPIRV)},
+    {"base.frag", BASE_FRAG_SPIRV, sizeof(BASE_FRAG_SPIRV)},
+    {"cull.comp", CULL_COMP_SPIRV, sizeof(CULL_COMP_SPIRV)},
+};
+
+static_assert(vertexInputsMatch<Vertex>(BASE_VERT_SPIRV), "shader/base.vert inputs do not match VertexLayout<Vertex>");
+static_assert(vertexInputsMatch<Vertex, InstanceData>(BASE_INSTANCED_VERT_SPIRV),
+              "shader/base_instanced.vert inputs do not match VertexLayout<Vertex> and VertexLayout<InstanceData>");
+static_assert(vertexInputsMatch<Snorm16Vertex, InstanceData>(BASE_INSTANCED_VERT_SPIRV) && vertexInputsMatch<Snorm16Vertex>(BASE_VERT_SPIRV),
+              "Base shaders cannot read VertexLayout<Snorm16Vertex>");
+static_assert(vertexInputsMatch<HalfVertex, InstanceData>(BASE_INSTANCED_VERT_SPIRV) && vertexInputsMatch<HalfVertex>(BASE_VERT_SPIRV),
+              "Base shaders cannot read VertexLayout<HalfVertex>");
+
+void ShaderRegistry::init(VkDevice device)
+{
+    this->device = device;
+}
+
+void ShaderRegistry::destroy()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for(auto& [name, shaderModule] : modules){
+        vkDestroyShaderModule(device, shaderModule, nullptr);
+    }
+    modules.clear();
+}
+
+VkShaderModule ShaderRegistry::get(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = modules.find(name);
+    if(found != modules.end()){
+        return found->second;
+    }
+
+    for(const EmbeddedShader& shader : EMBEDDED_SHADERS){
+        if(name != shader.name) continue;
+
+        VkShaderModuleCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = shader.size;
+        createInfo.pCode = shader.code;
+
+        VkShaderModule shaderModule;
+        if(vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS){
+            throw std::runtime_error("Failed to create shader module " + name);
+        }
+        modules[name] = shaderModule;
+        return shaderModule;
+    }
+    throw std::runtime_error("No embedded shader named " + name);
+}
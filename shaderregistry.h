@@ -0,0 +1,31 @@
+#ifndef SHADERREGISTRY_H
+#define SHADERREGISTRY_H
+
+#ifndef GLFW_INCLUDE_VULKAN
+    #define GLFW_INCLUDE_VULKAN
+    #include <GLFW/glfw3.h>
+#endif
+
+#include <map>
+#include <mutex>
+#include <string>
+
+// Shader modules built from the embedded SPIR-V, keyed by source file name (e.g. "base.vert").
+// Each module is created on first use and lives until destroy(), so pipeline rebuilds
+// never touch the file system or recreate modules.
+class ShaderRegistry
+{
+public:
+    void init(VkDevice device);
+    void destroy();
+
+    // Safe to call from pipeline compile jobs
+    VkShaderModule get(const std::string& name);
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    std::mutex mutex;
+    std::map<std::string, VkShaderModule> modules;
+};
+
+#endif // SHADERREGISTRY_H
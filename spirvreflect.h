@@ -0,0 +1,146 @@
+#ifndef SPIRVREFLECT_H
+#define SPIRVREFLECT_H
+
+#include "vertexlayout.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Just enough SPIR-V parsing to read the vertex inputs of a shader in a constant expression,
+// so the embedded shaders can be checked against the vertex layouts with static_assert.
+
+struct SpirvInput{
+    uint32_t location;
+    uint32_t components;
+    // A matrix input takes one location per column
+    uint32_t columns;
+    NumericType type;
+};
+
+class SpirvModule
+{
+public:
+    template<size_t N>
+    constexpr SpirvModule(const uint32_t (&code)[N]) : code(code), words(N) {}
+
+    constexpr bool isValid() const{
+        return words >= HEADER_WORDS && code[0] == MAGIC;
+    }
+
+    // Calls f(SpirvInput) for every Input variable with a location, built-ins are skipped.
+    // Returns false when an input has a type this parser does not understand.
+    template<typename F>
+    constexpr bool forEachInput(F&& f) const{
+        for(size_t i = HEADER_WORDS; i < words; i += wordCount(i)){
+            if(opcode(i) != OP_VARIABLE || code[i + 3] != STORAGE_INPUT) continue;
+
+            uint32_t location = 0;
+            if(!findDecoration(code[i + 2], DECORATION_LOCATION, location)) continue;
+
+            SpirvInput input{location, 0, 1, NumericType::Float};
+            size_t pointer = findType(code[i + 1]);
+            if(pointer == 0 || opcode(pointer) != OP_TYPE_POINTER) return false;
+            if(!resolveType(code[pointer + 3], input)) return false;
+            f(input);
+        }
+        return true;
+    }
+
+private:
+    static constexpr uint32_t MAGIC = 0x07230203;
+    static constexpr size_t HEADER_WORDS = 5;
+
+    static constexpr uint32_t OP_DECORATE = 71;
+    static constexpr uint32_t OP_TYPE_INT = 21;
+    static constexpr uint32_t OP_TYPE_FLOAT = 22;
+    static constexpr uint32_t OP_TYPE_VECTOR = 23;
+    static constexpr uint32_t OP_TYPE_MATRIX = 24;
+    static constexpr uint32_t OP_TYPE_POINTER = 32;
+    static constexpr uint32_t OP_VARIABLE = 59;
+    static constexpr uint32_t DECORATION_LOCATION = 30;
+    static constexpr uint32_t STORAGE_INPUT = 1;
+
+    const uint32_t* code;
+    size_t words;
+
+    constexpr uint32_t opcode(size_t i) const{
+        return code[i] & 0xffff;
+    }
+
+    // A zero word count would loop forever on a corrupt module, so it ends the walk instead
+    constexpr size_t wordCount(size_t i) const{
+        size_t count = code[i] >> 16;
+        return count == 0 ? words : count;
+    }
+
+    constexpr bool findDecoration(uint32_t id, uint32_t decoration, uint32_t& value) const{
+        for(size_t i = HEADER_WORDS; i < words; i += wordCount(i)){
+            if(opcode(i) == OP_DECORATE && wordCount(i) >= 4 && code[i + 1] == id && code[i + 2] == decoration){
+                value = code[i + 3];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Type declarations put their result id in the first operand
+    constexpr size_t findType(uint32_t id) const{
+        for(size_t i = HEADER_WORDS; i < words; i += wordCount(i)){
+            uint32_t op = opcode(i);
+            if(op >= OP_TYPE_INT && op <= OP_TYPE_POINTER && code[i + 1] == id) return i;
+        }
+        return 0;
+    }
+
+    constexpr bool resolveType(uint32_t id, SpirvInput& input) const{
+        size_t type = findType(id);
+        if(type == 0) return false;
+
+        switch(opcode(type)){
+        case OP_TYPE_FLOAT:
+            input.components = input.components == 0 ? 1 : input.components;
+            input.type = NumericType::Float;
+            return true;
+        case OP_TYPE_INT:
+            input.components = input.components == 0 ? 1 : input.components;
+            input.type = code[type + 3] ? NumericType::Sint : NumericType::Uint;
+            return true;
+        case OP_TYPE_VECTOR:
+            input.components = code[type + 3];
+            return resolveType(code[type + 2], input);
+        case OP_TYPE_MATRIX:
+            input.columns = code[type + 3];
+            return resolveType(code[type + 2], input);
+        default:
+            return false;
+        }
+    }
+};
+
+// Every location the shader reads has to be fed by an attribute of one of the vertex layouts with
+// the same numeric type. Attributes the shader does not read are fine, and so are component
+// counts that differ, Vulkan drops the extra components and fills missing ones from (0, 0, 0, 1).
+template<typename... Vertices>
+constexpr bool vertexInputsMatch(SpirvModule shader){
+    if(!shader.isValid()) return false;
+
+    bool matches = true;
+    bool parsed = shader.forEachInput([&matches](const SpirvInput& input){
+        for(uint32_t column = 0; column < input.columns; column++){
+            uint32_t location = input.location + column;
+            bool fed = false;
+            auto findIn = [&](const auto& attributes){
+                for(const VertexAttribute& attribute : attributes){
+                    if(location >= attribute.location && location < attribute.location + attribute.columns){
+                        fed = vertexFormatInfo(attribute.format).type == input.type;
+                    }
+                }
+            };
+            (findIn(VertexLayout<Vertices>::attributes), ...);
+            matches = matches && fed;
+        }
+    });
+    return parsed && matches;
+}
+
+#endif // SPIRVREFLECT_H
@@ -8,18 +8,86 @@
 
 #include <glm/glm.hpp>
 
+#include "vertexlayout.h"
+
 #include <cstdint>
 #include <optional>
 #include <vector>
 #include <array>
+#include <string>
+
+// Storage of the scene's vertex positions and colours, see vertexquantizer.h
+enum class VertexFormat{
+    Float,
+    Half,
+    Snorm16,
+};
+
+struct AppSettings{
+    // Number of frames the CPU may record ahead of the GPU, clamped to 1..4
+    uint32_t framesInFlight = 2;
+    // Benchmark mode renders this many frames, reports the frame rate and exits, 0 disables it
+    uint32_t benchmarkFrames = 0;
+    // Milliseconds of busy CPU work added to every frame to emulate a CPU bound scene
+    double simulatedCpuLoad = 0.0;
+    // Render into offscreen images without a window, surface or swapchain
+    bool headless = false;
+    VkFormat headlessFormat = VK_FORMAT_R8G8B8A8_UNORM;
+    // Headless only: the last rendered frame is saved to this PPM file before exit
+    std::string capturePath;
+    // Print per-stage CPU/GPU timing percentiles on exit
+    bool profile = false;
+    // When set, the profiled frame history is written to this file as a Chrome trace-event JSON on exit
+    std::string tracePath;
+    // Synthetic scene: a grid of objects, each a subdivided quad with at least this many triangles
+    uint32_t objectCount = 1;
+    uint32_t trianglesPerObject = 2;
+    // Mesh file drawn for every object instead of the grid, its own vertex format overrides vertexFormat
+    std::string meshPath;
+    // Reorder the scene mesh for vertex cache, overdraw and fetch locality before it is uploaded or saved
+    bool optimizeMesh = false;
+    // When set, the scene mesh is written to this file as a mesh file before rendering
+    std::string saveMeshPath;
+    // Draw every object of the synthetic scene as an instance of one indexed draw
+    bool instanced = false;
+    // Cull instances against the frustum in a compute pass and draw the survivors indirectly, implies instanced
+    bool gpuCulling = false;
+    // Compact formats quantize positions against the mesh bounds and store colours as RGBA8
+    VertexFormat vertexFormat = VertexFormat::Float;
+    // Scene material: wireframe needs the fillModeNonSolid feature, greyscale is a fragment specialization constant
+    bool wireframe = false;
+    bool greyscale = false;
+    // Threads running engine jobs including the main thread, 0 picks the hardware concurrency
+    uint32_t workerThreads = 0;
+    // Pin every job thread to its own core
+    bool pinThreads = false;
+    // Pipeline cache loaded at startup and written back on exit, empty disables it
+    std::string pipelineCachePath = "pipeline_cache.bin";
+    // Seconds between memory reports from the main loop, 0 disables them
+    double memoryReportInterval = 0.0;
+    // When set, each report is appended to this file as one JSON object per line instead of the log.
+    // --memory-report-json alone reports every second.
+    std::string memoryReportPath;
+};
 
 struct QueueFamilyIndices{
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    // Only set for families that do not support graphics, otherwise work falls back to the graphics queue
+    std::optional<uint32_t> transferFamily;
+    std::optional<uint32_t> computeFamily;
 
     bool isComplete(){
         return graphicsFamily.has_value() && presentFamily.has_value();
     }
+
+    uint32_t transferOrGraphics() const{
+        return transferFamily.value_or(graphicsFamily.value());
+    }
+
+    uint32_t computeOrGraphics() const{
+        return computeFamily.value_or(graphicsFamily.value());
+    }
 };
 
 struct SwapChainSupportDetails{
@@ -46,27 +114,67 @@ struct Vertex{
         this->pos = glm::vec3(0.0);
         this->color = glm::vec4(1.0);
     }
+};
 
-    static VkVertexInputBindingDescription getBindingDescription(){
-        VkVertexInputBindingDescription bindingDesc{};
-        bindingDesc.binding = 0;
-        bindingDesc.stride = sizeof (Vertex);
-        bindingDesc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-        return bindingDesc;
-    }
+template<> struct VertexLayout<Vertex>{
+    static constexpr uint32_t binding = 0;
+    static constexpr VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    static constexpr std::array attributes = {
+        VERTEX_ATTRIBUTE(Vertex, pos, 0),
+        VERTEX_ATTRIBUTE(Vertex, color, 2),
+    };
+};
 
-    static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescription(){
-        std::array<VkVertexInputAttributeDescription, 2> attribDescs{};
-        attribDescs[0].binding = 0;
-        attribDescs[0].location = 0;
-        attribDescs[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attribDescs[0].offset = offsetof(Vertex, pos);
-        attribDescs[1].binding = 0;
-        attribDescs[1].location = 2;
-        attribDescs[1].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-        attribDescs[1].offset = offsetof(Vertex, color);
-        return attribDescs;
-    }
+// Compact vertices of 12 instead of 28 bytes. Positions are normalized to [-1, 1] over the mesh
+// bounds and the object transforms undo it. They carry exactly the attributes of Vertex, which the
+// shaders read as floats whatever the format. Location 1 stays free for normals.
+struct Snorm16Vertex{
+    int16_t pos[4];
+    uint8_t color[4];
+};
+
+struct HalfVertex{
+    uint16_t pos[4];
+    uint8_t color[4];
+};
+
+template<> struct VertexLayout<Snorm16Vertex>{
+    static constexpr uint32_t binding = 0;
+    static constexpr VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    static constexpr std::array attributes = {
+        VERTEX_ATTRIBUTE_FORMAT(Snorm16Vertex, pos, 0, VK_FORMAT_R16G16B16A16_SNORM),
+        VERTEX_ATTRIBUTE_FORMAT(Snorm16Vertex, color, 2, VK_FORMAT_R8G8B8A8_UNORM),
+    };
+};
+
+template<> struct VertexLayout<HalfVertex>{
+    static constexpr uint32_t binding = 0;
+    static constexpr VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    static constexpr std::array attributes = {
+        VERTEX_ATTRIBUTE_FORMAT(HalfVertex, pos, 0, VK_FORMAT_R16G16B16A16_SFLOAT),
+        VERTEX_ATTRIBUTE_FORMAT(HalfVertex, color, 2, VK_FORMAT_R8G8B8A8_UNORM),
+    };
+};
+
+// Per-instance stream bound at binding 1, read by shader/base_instanced.vert
+struct InstanceData{
+    glm::mat4 transform;
+    glm::vec4 color;
+};
+
+template<> struct VertexLayout<InstanceData>{
+    static constexpr uint32_t binding = 1;
+    static constexpr VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+    static constexpr std::array attributes = {
+        VERTEX_ATTRIBUTE(InstanceData, transform, 3),
+        VERTEX_ATTRIBUTE(InstanceData, color, 7),
+    };
+};
+
+// Push constants of shader/cull.comp, planes are normalized with the inside on the positive side
+struct CullPushConstants{
+    glm::vec4 planes[6];
+    uint32_t objectCount;
 };
 
 struct UniformBufferObject{
@@ -0,0 +1,302 @@
+#include "uploadmanager.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+void UploadManager::init(VkDevice device, VkQueue queue, uint32_t queueFamily, VkQueue graphicsQueue, uint32_t graphicsFamily,
+                         VkBuffer stagingBuffer, void *stagingMapped, VkDeviceSize stagingSize)
+{
+    this->device = device;
+    this->queue = queue;
+    this->queueFamily = queueFamily;
+    this->graphicsQueue = graphicsQueue;
+    this->graphicsFamily = graphicsFamily;
+    this->stagingBuffer = stagingBuffer;
+    this->stagingMapped = static_cast<char*>(stagingMapped);
+    this->stagingSize = stagingSize;
+
+    commandPool = createPool(queueFamily);
+    if(transfersOwnership()){
+        acquireCommandPool = createPool(graphicsFamily);
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for(auto& batch : batches){
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+
+        if(vkAllocateCommandBuffers(device, &allocInfo, &batch.commandBuffer) != VK_SUCCESS){
+            throw std::runtime_error("Failed to allocate upload command buffers!");
+        }
+        if(vkCreateFence(device, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS){
+            throw std::runtime_error("Failed to create upload fence!");
+        }
+
+        if(transfersOwnership()){
+            allocInfo.commandPool = acquireCommandPool;
+            if(vkAllocateCommandBuffers(device, &allocInfo, &batch.acquireCommandBuffer) != VK_SUCCESS ||
+                    vkCreateSemaphore(device, &semaphoreInfo, nullptr, &batch.transferDone) != VK_SUCCESS){
+                throw std::runtime_error("Failed to create upload ownership transfer objects!");
+            }
+        }
+    }
+}
+
+void UploadManager::destroy()
+{
+    waitIdle();
+    for(auto& batch : batches){
+        vkDestroyFence(device, batch.fence, nullptr);
+        if(batch.transferDone != VK_NULL_HANDLE){
+            vkDestroySemaphore(device, batch.transferDone, nullptr);
+        }
+    }
+    vkDestroyCommandPool(device, commandPool, nullptr);
+    if(acquireCommandPool != VK_NULL_HANDLE){
+        vkDestroyCommandPool(device, acquireCommandPool, nullptr);
+    }
+}
+
+uint64_t UploadManager::enqueueBufferUpload(VkBuffer dst, VkDeviceSize dstOffset, const void *data, VkDeviceSize size)
+{
+    const char* src = static_cast<const char*>(data);
+    uint64_t ticket = 0;
+
+    // Uploads bigger than the ring go through it in pieces
+    while(size > 0){
+        VkDeviceSize chunk = std::min(size, stagingSize);
+        uint64_t position = reserve(chunk);
+        Batch& batch = beginBatch();
+
+        VkDeviceSize stagingOffset = position % stagingSize;
+        memcpy(stagingMapped + stagingOffset, src, chunk);
+
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = stagingOffset;
+        copyRegion.dstOffset = dstOffset;
+        copyRegion.size = chunk;
+        vkCmdCopyBuffer(batch.commandBuffer, stagingBuffer, dst, 1, &copyRegion);
+
+        if(transfersOwnership()){
+            VkBufferMemoryBarrier ownership{};
+            ownership.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            ownership.srcQueueFamilyIndex = queueFamily;
+            ownership.dstQueueFamilyIndex = graphicsFamily;
+            ownership.buffer = dst;
+            ownership.offset = dstOffset;
+            ownership.size = chunk;
+            batch.ownershipBarriers.push_back(ownership);
+        }
+
+        batch.copyCount++;
+        batch.ringEnd = ringHead;
+        ticket = batch.ticket;
+
+        src += chunk;
+        dstOffset += chunk;
+        size -= chunk;
+    }
+
+    return ticket;
+}
+
+uint64_t UploadManager::flush()
+{
+    if(!recording) return nextTicket - 1;
+
+    Batch& batch = batches[recordingBatch];
+
+    if(transfersOwnership()){
+        // Release on the transfer queue, dstAccessMask is ignored for the releasing half
+        for(auto& barrier : batch.ownershipBarriers){
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+        }
+        vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                             0, nullptr, batch.ownershipBarriers.size(), batch.ownershipBarriers.data(), 0, nullptr);
+    } else {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    if(vkEndCommandBuffer(batch.commandBuffer) != VK_SUCCESS){
+        throw std::runtime_error("Failed to record upload command buffer!");
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+
+    if(!transfersOwnership()){
+        if(vkQueueSubmit(queue, 1, &submitInfo, batch.fence) != VK_SUCCESS){
+            throw std::runtime_error("Failed to submit upload batch!");
+        }
+    } else {
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &batch.transferDone;
+        if(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS){
+            throw std::runtime_error("Failed to submit upload batch!");
+        }
+
+        // Acquire on the graphics queue, the fence here also covers the transfer submission it waits on
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(batch.acquireCommandBuffer, &beginInfo);
+
+        for(auto& barrier : batch.ownershipBarriers){
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        }
+        vkCmdPipelineBarrier(batch.acquireCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                             0, nullptr, batch.ownershipBarriers.size(), batch.ownershipBarriers.data(), 0, nullptr);
+
+        if(vkEndCommandBuffer(batch.acquireCommandBuffer) != VK_SUCCESS){
+            throw std::runtime_error("Failed to record upload acquire command buffer!");
+        }
+
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        VkSubmitInfo acquireInfo{};
+        acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        acquireInfo.waitSemaphoreCount = 1;
+        acquireInfo.pWaitSemaphores = &batch.transferDone;
+        acquireInfo.pWaitDstStageMask = &waitStage;
+        acquireInfo.commandBufferCount = 1;
+        acquireInfo.pCommandBuffers = &batch.acquireCommandBuffer;
+
+        if(vkQueueSubmit(graphicsQueue, 1, &acquireInfo, batch.fence) != VK_SUCCESS){
+            throw std::runtime_error("Failed to submit upload acquire batch!");
+        }
+    }
+
+    inFlight.push_back(recordingBatch);
+    recording = false;
+    nextTicket++;
+    return batch.ticket;
+}
+
+bool UploadManager::isComplete(uint64_t ticket)
+{
+    while(!inFlight.empty() && vkGetFenceStatus(device, batches[inFlight.front()].fence) == VK_SUCCESS){
+        retireOldest();
+    }
+    return completedTicket >= ticket;
+}
+
+void UploadManager::wait(uint64_t ticket)
+{
+    if(recording && batches[recordingBatch].ticket <= ticket){
+        flush();
+    }
+    while(completedTicket < ticket && !inFlight.empty()){
+        retireOldest();
+    }
+}
+
+void UploadManager::waitIdle()
+{
+    flush();
+    while(!inFlight.empty()){
+        retireOldest();
+    }
+}
+
+UploadManager::Batch &UploadManager::beginBatch()
+{
+    if(recording) return batches[recordingBatch];
+
+    if(inFlight.size() == BATCH_COUNT){
+        retireOldest();
+    }
+
+    for(uint32_t i = 0; i < BATCH_COUNT; i++){
+        if(std::find(inFlight.begin(), inFlight.end(), i) == inFlight.end()){
+            recordingBatch = i;
+            break;
+        }
+    }
+
+    Batch& batch = batches[recordingBatch];
+    batch.ticket = nextTicket;
+    batch.copyCount = 0;
+    batch.ringEnd = ringHead;
+    batch.ownershipBarriers.clear();
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if(vkBeginCommandBuffer(batch.commandBuffer, &beginInfo) != VK_SUCCESS){
+        throw std::runtime_error("Failed to begin upload command buffer!");
+    }
+
+    recording = true;
+    return batch;
+}
+
+uint64_t UploadManager::reserve(VkDeviceSize size)
+{
+    while(true){
+        uint64_t position = (ringHead + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+        VkDeviceSize physical = position % stagingSize;
+        if(physical + size > stagingSize){
+            position += stagingSize - physical;
+        }
+
+        if(position + size - ringTail <= stagingSize){
+            ringHead = position + size;
+            return position;
+        }
+
+        if(recording){
+            flush();
+        } else if(!inFlight.empty()){
+            retireOldest();
+        } else {
+            ringHead = 0;
+            ringTail = 0;
+        }
+    }
+}
+
+bool UploadManager::transfersOwnership() const
+{
+    return queueFamily != graphicsFamily;
+}
+
+VkCommandPool UploadManager::createPool(uint32_t family)
+{
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = family;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+    VkCommandPool pool;
+    if(vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create upload command pool!");
+    }
+    return pool;
+}
+
+void UploadManager::retireOldest()
+{
+    Batch& batch = batches[inFlight.front()];
+    vkWaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+    vkResetFences(device, 1, &batch.fence);
+
+    completedTicket = batch.ticket;
+    ringTail = batch.ringEnd;
+    inFlight.pop_front();
+}
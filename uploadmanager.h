@@ -0,0 +1,77 @@
+#ifndef UPLOADMANAGER_H
+#define UPLOADMANAGER_H
+
+#ifndef GLFW_INCLUDE_VULKAN
+    #define GLFW_INCLUDE_VULKAN
+    #include <GLFW/glfw3.h>
+#endif
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Collects buffer uploads into a reusable staging ring and submits them in batches.
+// Every batch ends with a barrier making the copies visible to later graphics work,
+// so callers only wait on a ticket when the CPU itself needs the staging space or the result.
+// When copies run on a dedicated transfer family, buffer ownership is released there and
+// acquired on the graphics queue by a small submission that waits on the transfer semaphore.
+class UploadManager
+{
+public:
+    void init(VkDevice device, VkQueue queue, uint32_t queueFamily, VkQueue graphicsQueue, uint32_t graphicsFamily,
+              VkBuffer stagingBuffer, void* stagingMapped, VkDeviceSize stagingSize);
+    void destroy();
+
+    uint64_t enqueueBufferUpload(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+    uint64_t flush();
+
+    bool isComplete(uint64_t ticket);
+    void wait(uint64_t ticket);
+    void waitIdle();
+
+private:
+    static constexpr uint32_t BATCH_COUNT = 4;
+    static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+    struct Batch{
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;
+        VkSemaphore transferDone = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        std::vector<VkBufferMemoryBarrier> ownershipBarriers;
+        uint64_t ticket = 0;
+        uint64_t ringEnd = 0;
+        uint32_t copyCount = 0;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueue queue = VK_NULL_HANDLE;
+    VkQueue graphicsQueue = VK_NULL_HANDLE;
+    uint32_t queueFamily = 0;
+    uint32_t graphicsFamily = 0;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkCommandPool acquireCommandPool = VK_NULL_HANDLE;
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    char* stagingMapped = nullptr;
+    VkDeviceSize stagingSize = 0;
+
+    // Ring positions grow monotonically, the physical offset is position % stagingSize
+    uint64_t ringHead = 0;
+    uint64_t ringTail = 0;
+
+    std::array<Batch, BATCH_COUNT> batches;
+    uint32_t recordingBatch = 0;
+    bool recording = false;
+    std::deque<uint32_t> inFlight;
+    uint64_t nextTicket = 1;
+    uint64_t completedTicket = 0;
+
+    bool transfersOwnership() const;
+    VkCommandPool createPool(uint32_t family);
+    Batch& beginBatch();
+    uint64_t reserve(VkDeviceSize size);
+    void retireOldest();
+};
+
+#endif // UPLOADMANAGER_H
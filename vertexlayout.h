@@ -0,0 +1,160 @@
+#ifndef VERTEXLAYOUT_H
+#define VERTEXLAYOUT_H
+
+#ifndef GLFW_INCLUDE_VULKAN
+    #define GLFW_INCLUDE_VULKAN
+    #include <GLFW/glfw3.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Vertex structs declare their members once in a VertexLayout specialization and the Vulkan
+// binding and attribute descriptions are generated from it at compile time:
+//
+//     template<> struct VertexLayout<Vertex>{
+//         static constexpr uint32_t binding = 0;
+//         static constexpr VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+//         static constexpr std::array attributes = {
+//             VERTEX_ATTRIBUTE(Vertex, pos, 0),
+//             VERTEX_ATTRIBUTE(Vertex, color, 2),
+//         };
+//     };
+//
+// The format comes from the member type through VertexFormatOf, so a new member type only
+// needs one specialization there. See spirvreflect.h for checking a layout against a shader.
+
+enum class NumericType{
+    Float,
+    Sint,
+    Uint,
+};
+
+struct VertexFormatInfo{
+    uint32_t components = 0;
+    uint32_t size = 0;
+    // What the shader reads, normalized and half formats all arrive as floats
+    NumericType type = NumericType::Float;
+};
+
+constexpr VertexFormatInfo vertexFormatInfo(VkFormat format){
+    switch(format){
+    case VK_FORMAT_R32_SFLOAT: return {1, 4, NumericType::Float};
+    case VK_FORMAT_R32G32_SFLOAT: return {2, 8, NumericType::Float};
+    case VK_FORMAT_R32G32B32_SFLOAT: return {3, 12, NumericType::Float};
+    case VK_FORMAT_R32G32B32A32_SFLOAT: return {4, 16, NumericType::Float};
+    case VK_FORMAT_R32_UINT: return {1, 4, NumericType::Uint};
+    case VK_FORMAT_R32G32_UINT: return {2, 8, NumericType::Uint};
+    case VK_FORMAT_R32G32B32_UINT: return {3, 12, NumericType::Uint};
+    case VK_FORMAT_R32G32B32A32_UINT: return {4, 16, NumericType::Uint};
+    case VK_FORMAT_R32_SINT: return {1, 4, NumericType::Sint};
+    case VK_FORMAT_R32G32_SINT: return {2, 8, NumericType::Sint};
+    case VK_FORMAT_R32G32B32_SINT: return {3, 12, NumericType::Sint};
+    case VK_FORMAT_R32G32B32A32_SINT: return {4, 16, NumericType::Sint};
+    case VK_FORMAT_R16G16_SFLOAT: return {2, 4, NumericType::Float};
+    case VK_FORMAT_R16G16B16A16_SFLOAT: return {4, 8, NumericType::Float};
+    case VK_FORMAT_R16G16_UNORM: return {2, 4, NumericType::Float};
+    case VK_FORMAT_R16G16_SNORM: return {2, 4, NumericType::Float};
+    case VK_FORMAT_R16G16B16A16_UNORM: return {4, 8, NumericType::Float};
+    case VK_FORMAT_R16G16B16A16_SNORM: return {4, 8, NumericType::Float};
+    case VK_FORMAT_R16G16_UINT: return {2, 4, NumericType::Uint};
+    case VK_FORMAT_R16G16_SINT: return {2, 4, NumericType::Sint};
+    case VK_FORMAT_R16G16B16A16_UINT: return {4, 8, NumericType::Uint};
+    case VK_FORMAT_R16G16B16A16_SINT: return {4, 8, NumericType::Sint};
+    case VK_FORMAT_R8G8_SNORM: return {2, 2, NumericType::Float};
+    case VK_FORMAT_R8G8B8A8_UNORM: return {4, 4, NumericType::Float};
+    case VK_FORMAT_R8G8B8A8_SNORM: return {4, 4, NumericType::Float};
+    case VK_FORMAT_R8G8B8A8_UINT: return {4, 4, NumericType::Uint};
+    case VK_FORMAT_R8G8B8A8_SINT: return {4, 4, NumericType::Sint};
+    case VK_FORMAT_A2B10G10R10_SNORM_PACK32: return {4, 4, NumericType::Float};
+    default: return {};
+    }
+}
+
+// Maps a vertex member type to its format. Matrices take one location per column.
+template<typename T> struct VertexFormatOf;
+
+template<> struct VertexFormatOf<float>{ static constexpr VkFormat format = VK_FORMAT_R32_SFLOAT; static constexpr uint32_t columns = 1; };
+template<> struct VertexFormatOf<glm::vec2>{ static constexpr VkFormat format = VK_FORMAT_R32G32_SFLOAT; static constexpr uint32_t columns = 1; };
+template<> struct VertexFormatOf<glm::vec3>{ static constexpr VkFormat format = VK_FORMAT_R32G32B32_SFLOAT; static constexpr uint32_t columns = 1; };
+template<> struct VertexFormatOf<glm::vec4>{ static constexpr VkFormat format = VK_FORMAT_R32G32B32A32_SFLOAT; static constexpr uint32_t columns = 1; };
+template<> struct VertexFormatOf<glm::mat4>{ static constexpr VkFormat format = VK_FORMAT_R32G32B32A32_SFLOAT; static constexpr uint32_t columns = 4; };
+template<> struct VertexFormatOf<uint32_t>{ static constexpr VkFormat format = VK_FORMAT_R32_UINT; static constexpr uint32_t columns = 1; };
+template<> struct VertexFormatOf<int32_t>{ static constexpr VkFormat format = VK_FORMAT_R32_SINT; static constexpr uint32_t columns = 1; };
+
+struct VertexAttribute{
+    uint32_t location;
+    VkFormat format;
+    uint32_t offset;
+    uint32_t columns = 1;
+};
+
+template<typename Member>
+constexpr VertexAttribute vertexAttribute(uint32_t location, size_t offset){
+    return {location, VertexFormatOf<Member>::format, static_cast<uint32_t>(offset), VertexFormatOf<Member>::columns};
+}
+
+// Same as vertexAttribute but with the format spelled out, for members whose type alone is ambiguous
+constexpr VertexAttribute vertexAttribute(uint32_t location, VkFormat format, size_t offset){
+    return {location, format, static_cast<uint32_t>(offset), 1};
+}
+
+#define VERTEX_ATTRIBUTE(type, member, location) \
+    vertexAttribute<decltype(type::member)>(location, offsetof(type, member))
+#define VERTEX_ATTRIBUTE_FORMAT(type, member, location, format) \
+    vertexAttribute(location, format, offsetof(type, member))
+
+template<typename T> struct VertexLayout;
+
+template<typename T>
+constexpr uint32_t vertexLocationCount(){
+    uint32_t count = 0;
+    for(const VertexAttribute& attribute : VertexLayout<T>::attributes){
+        count += attribute.columns;
+    }
+    return count;
+}
+
+// Every location used once and every attribute inside the vertex
+template<typename T>
+constexpr bool isValidVertexLayout(){
+    const auto& attributes = VertexLayout<T>::attributes;
+    for(size_t i = 0; i < attributes.size(); i++){
+        VertexFormatInfo info = vertexFormatInfo(attributes[i].format);
+        if(info.components == 0) return false;
+        if(attributes[i].offset + info.size * attributes[i].columns > sizeof(T)) return false;
+
+        for(size_t j = i + 1; j < attributes.size(); j++){
+            bool disjoint = attributes[i].location + attributes[i].columns <= attributes[j].location
+                         || attributes[j].location + attributes[j].columns <= attributes[i].location;
+            if(!disjoint) return false;
+        }
+    }
+    return true;
+}
+
+template<typename T>
+constexpr VkVertexInputBindingDescription vertexBindingDescription(){
+    return {VertexLayout<T>::binding, static_cast<uint32_t>(sizeof(T)), VertexLayout<T>::inputRate};
+}
+
+template<typename T>
+constexpr std::array<VkVertexInputAttributeDescription, vertexLocationCount<T>()> vertexAttributeDescriptions(){
+    static_assert(isValidVertexLayout<T>(), "Vertex layout has an unknown format, overlapping locations or an attribute outside the vertex");
+
+    std::array<VkVertexInputAttributeDescription, vertexLocationCount<T>()> descriptions{};
+    size_t index = 0;
+    for(const VertexAttribute& attribute : VertexLayout<T>::attributes){
+        uint32_t columnSize = vertexFormatInfo(attribute.format).size;
+        for(uint32_t column = 0; column < attribute.columns; column++){
+            descriptions[index++] = {attribute.location + column, VertexLayout<T>::binding, attribute.format,
+                                     attribute.offset + columnSize * column};
+        }
+    }
+    return descriptions;
+}
+
+#endif // VERTEXLAYOUT_H
@@ -0,0 +1,290 @@
+#include "vertexquantizer.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define QUANTIZER_SSE2
+    #include <emmintrin.h>
+#endif
+// The half conversion is compiled for F16C whatever the build targets and only runs when the CPU
+// reports it, the rest of the file stays on the baseline instruction set
+#if defined(QUANTIZER_SSE2) && (defined(__GNUC__) || defined(_MSC_VER))
+    #define QUANTIZER_F16C
+    #include <immintrin.h>
+    #if defined(_MSC_VER) && !defined(__clang__)
+        #include <intrin.h>
+        #define F16C_TARGET
+    #else
+        #include <cpuid.h>
+        #define F16C_TARGET __attribute__((target("f16c")))
+    #endif
+#endif
+
+static constexpr float SNORM16_MAX = 32767.0f;
+
+const char *vertexFormatName(VertexFormat format)
+{
+    switch(format){
+    case VertexFormat::Half: return "half";
+    case VertexFormat::Snorm16: return "snorm16";
+    default: return "float";
+    }
+}
+
+VertexFormat parseVertexFormat(const std::string &name)
+{
+    if(name == "float") return VertexFormat::Float;
+    if(name == "half") return VertexFormat::Half;
+    if(name == "snorm16") return VertexFormat::Snorm16;
+    throw std::runtime_error("Unknown vertex format: " + name);
+}
+
+uint32_t vertexFormatStride(VertexFormat format)
+{
+    switch(format){
+    case VertexFormat::Half: return sizeof(HalfVertex);
+    case VertexFormat::Snorm16: return sizeof(Snorm16Vertex);
+    default: return sizeof(Vertex);
+    }
+}
+
+VertexQuantization VertexQuantization::fromBounds(const Vertex *vertices, size_t count)
+{
+    VertexQuantization quantization;
+    if(count == 0) return quantization;
+
+    glm::vec3 low = vertices[0].pos;
+    glm::vec3 high = vertices[0].pos;
+    for(size_t i = 1; i < count; i++){
+        low = glm::min(low, vertices[i].pos);
+        high = glm::max(high, vertices[i].pos);
+    }
+    quantization.offset = (low + high) * 0.5f;
+    quantization.scale = (high - low) * 0.5f;
+    // A flat axis stores zeros, any scale restores it
+    for(int axis = 0; axis < 3; axis++){
+        if(!(quantization.scale[axis] > 0.0f)){
+            quantization.scale[axis] = 1.0f;
+        }
+    }
+    return quantization;
+}
+
+glm::mat4 VertexQuantization::dequantizeMatrix() const
+{
+    return glm::scale(glm::translate(glm::mat4(1.0f), offset), scale);
+}
+
+uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7fffffff;
+
+    if(magnitude >= 0x7f800000){
+        return static_cast<uint16_t>(sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0));
+    }
+    // 65520 and above round past the largest half
+    if(magnitude >= 0x477ff000){
+        return static_cast<uint16_t>(sign | 0x7c00);
+    }
+    if(magnitude < 0x38800000){
+        // Below half of the smallest subnormal
+        if(magnitude < 0x33000000) return static_cast<uint16_t>(sign);
+
+        uint32_t shift = 126 - (magnitude >> 23);
+        uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if(remainder > halfway || (remainder == halfway && (half & 1))){
+            half++;
+        }
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    uint32_t half = (magnitude - 0x38000000) >> 13;
+    uint32_t remainder = magnitude & 0x1fff;
+    if(remainder > 0x1000 || (remainder == 0x1000 && (half & 1))){
+        half++;
+    }
+    return static_cast<uint16_t>(sign | half);
+}
+
+float halfToFloat(uint16_t value)
+{
+    uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+
+    uint32_t bits;
+    if(exponent == 0x1f){
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else if(exponent != 0){
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else{
+        // Subnormal halves are normal floats, scaling the mantissa is exact
+        float magnitude = std::ldexp(static_cast<float>(mantissa), -24);
+        memcpy(&bits, &magnitude, sizeof(bits));
+        bits |= sign;
+    }
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+static void packColor(const glm::vec4& color, uint8_t* out)
+{
+#ifdef QUANTIZER_SSE2
+    __m128 clamped = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(&color.x), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    __m128i values = _mm_cvtps_epi32(_mm_mul_ps(clamped, _mm_set1_ps(255.0f)));
+    values = _mm_packs_epi32(values, values);
+    values = _mm_packus_epi16(values, values);
+    uint32_t packed = static_cast<uint32_t>(_mm_cvtsi128_si32(values));
+    memcpy(out, &packed, sizeof(packed));
+#else
+    for(int i = 0; i < 4; i++){
+        out[i] = static_cast<uint8_t>(std::nearbyint(std::clamp(color[i], 0.0f, 1.0f) * 255.0f));
+    }
+#endif
+}
+
+#ifdef QUANTIZER_SSE2
+struct PositionQuad{
+    __m128 x, y, z;
+};
+
+// Four positions mapped by (pos - offset) * factor, one register per axis. Loading four floats at pos
+// picks up color.r as the fourth row, the transpose moves it into w which is dropped.
+static inline PositionQuad loadPositions(const Vertex* vertices, const glm::vec3& offset, const glm::vec3& factor)
+{
+    __m128 x = _mm_loadu_ps(&vertices[0].pos.x);
+    __m128 y = _mm_loadu_ps(&vertices[1].pos.x);
+    __m128 z = _mm_loadu_ps(&vertices[2].pos.x);
+    __m128 w = _mm_loadu_ps(&vertices[3].pos.x);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    return {
+        _mm_mul_ps(_mm_sub_ps(x, _mm_set1_ps(offset.x)), _mm_set1_ps(factor.x)),
+        _mm_mul_ps(_mm_sub_ps(y, _mm_set1_ps(offset.y)), _mm_set1_ps(factor.y)),
+        _mm_mul_ps(_mm_sub_ps(z, _mm_set1_ps(offset.z)), _mm_set1_ps(factor.z)),
+    };
+}
+
+// xy holds four 16 bit x followed by four y, z four z and zeros above. Interleaves them back into
+// four x, y, z, 0 positions.
+template<typename CompactVertex>
+static inline void storePositions(__m128i xy, __m128i z, CompactVertex* out)
+{
+    __m128i xz = _mm_unpacklo_epi16(xy, z);
+    __m128i y0 = _mm_unpackhi_epi16(xy, z);
+    __m128i first = _mm_unpacklo_epi16(xz, y0);
+    __m128i second = _mm_unpackhi_epi16(xz, y0);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out[0].pos), first);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out[1].pos), _mm_unpackhi_epi64(first, first));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out[2].pos), second);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out[3].pos), _mm_unpackhi_epi64(second, second));
+}
+#endif
+
+void quantizeVertices(const Vertex *vertices, size_t count, const VertexQuantization &quantization, Snorm16Vertex *out)
+{
+    glm::vec3 factor = glm::vec3(SNORM16_MAX) / quantization.scale;
+    size_t i = 0;
+
+#ifdef QUANTIZER_SSE2
+    // Same clamp as the scalar loop, converting alone would saturate to -32768
+    __m128 low = _mm_set1_ps(-SNORM16_MAX);
+    __m128 high = _mm_set1_ps(SNORM16_MAX);
+    for(; i + 4 <= count; i += 4){
+        PositionQuad position = loadPositions(&vertices[i], quantization.offset, factor);
+        __m128i x = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(position.x, low), high));
+        __m128i y = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(position.y, low), high));
+        __m128i z = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(position.z, low), high));
+        storePositions(_mm_packs_epi32(x, y), _mm_packs_epi32(z, _mm_setzero_si128()), &out[i]);
+        for(size_t k = i; k < i + 4; k++){
+            packColor(vertices[k].color, out[k].color);
+        }
+    }
+#endif
+    for(; i < count; i++){
+        glm::vec3 position = (vertices[i].pos - quantization.offset) * factor;
+        for(int axis = 0; axis < 3; axis++){
+            out[i].pos[axis] = static_cast<int16_t>(std::nearbyint(std::clamp(position[axis], -SNORM16_MAX, SNORM16_MAX)));
+        }
+        out[i].pos[3] = 0;
+        packColor(vertices[i].color, out[i].color);
+    }
+}
+
+#ifdef QUANTIZER_F16C
+// F16C is VEX encoded, so besides the CPUID bit the OS has to save the AVX state
+static bool cpuSupportsF16C()
+{
+    static const bool supported = []{
+        unsigned int ecx;
+#if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 1);
+        ecx = static_cast<unsigned int>(info[2]);
+#else
+        unsigned int eax, ebx, edx;
+        if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+#endif
+        const unsigned int osxsave = 1u << 27, avx = 1u << 28, f16c = 1u << 29;
+        if((ecx & (osxsave | avx | f16c)) != (osxsave | avx | f16c)) return false;
+
+#if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long long xcr0 = _xgetbv(0);
+#else
+        unsigned int xcr0Low, xcr0High;
+        __asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+        unsigned long long xcr0 = xcr0Low;
+#endif
+        // XMM and YMM state
+        return (xcr0 & 6) == 6;
+    }();
+    return supported;
+}
+
+// Converts whole groups of four and returns how many vertices it did
+F16C_TARGET static size_t quantizeHalfF16C(const Vertex *vertices, size_t count, const glm::vec3 &offset,
+                                           const glm::vec3 &factor, HalfVertex *out)
+{
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4){
+        PositionQuad position = loadPositions(&vertices[i], offset, factor);
+        __m128i x = _mm_cvtps_ph(position.x, _MM_FROUND_TO_NEAREST_INT);
+        __m128i y = _mm_cvtps_ph(position.y, _MM_FROUND_TO_NEAREST_INT);
+        __m128i z = _mm_cvtps_ph(position.z, _MM_FROUND_TO_NEAREST_INT);
+        storePositions(_mm_unpacklo_epi64(x, y), z, &out[i]);
+        for(size_t k = i; k < i + 4; k++){
+            packColor(vertices[k].color, out[k].color);
+        }
+    }
+    return i;
+}
+#endif
+
+void quantizeVertices(const Vertex *vertices, size_t count, const VertexQuantization &quantization, HalfVertex *out)
+{
+    glm::vec3 factor = glm::vec3(1.0f) / quantization.scale;
+    size_t i = 0;
+
+#ifdef QUANTIZER_F16C
+    if(cpuSupportsF16C()){
+        i = quantizeHalfF16C(vertices, count, quantization.offset, factor, out);
+    }
+#endif
+    for(; i < count; i++){
+        glm::vec3 position = (vertices[i].pos - quantization.offset) * factor;
+        for(int axis = 0; axis < 3; axis++){
+            out[i].pos[axis] = floatToHalf(position[axis]);
+        }
+        out[i].pos[3] = 0;
+        packColor(vertices[i].color, out[i].color);
+    }
+}
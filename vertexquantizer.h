@@ -0,0 +1,33 @@
+#ifndef VERTEXQUANTIZER_H
+#define VERTEXQUANTIZER_H
+
+#include "structs.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+const char* vertexFormatName(VertexFormat format);
+VertexFormat parseVertexFormat(const std::string& name);
+uint32_t vertexFormatStride(VertexFormat format);
+
+// Maps positions into [-1, 1] per axis over the mesh bounds. The compact formats store the mapped
+// positions and dequantizeMatrix() is folded into the object transforms to restore them.
+struct VertexQuantization{
+    glm::vec3 offset = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+
+    static VertexQuantization fromBounds(const Vertex* vertices, size_t count);
+    glm::mat4 dequantizeMatrix() const;
+};
+
+// Convert count vertices, four at a time with SSE2, and with F16C for half floats when the CPU
+// supports it. Ranges may be converted in parallel.
+void quantizeVertices(const Vertex* vertices, size_t count, const VertexQuantization& quantization, Snorm16Vertex* out);
+void quantizeVertices(const Vertex* vertices, size_t count, const VertexQuantization& quantization, HalfVertex* out);
+
+// Round to nearest even, out of range values become infinity
+uint16_t floatToHalf(float value);
+float halfToFloat(uint16_t value);
+
+#endif // VERTEXQUANTIZER_H